@@ -1,16 +1,55 @@
 #include "pch.h"
 #include "src/core/Window.h"
 #include "src/graphics/renderers/Renderer.h"
+#include "src/dev/Benchmark.h"
 
 static Window s_window;
 static Renderer s_renderer;
 
-int main()
+int main(int argc, char** argv)
 {
 #if defined(DEBUG) && defined(WIN32)
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+    // Writes binary soft body assets from the obj files: convert <name> <resolution>...
+    if (argc > 3 && std::string(argv[1]) == "convert")
+    {
+        ThreadPool threadPool;
+        threadPool.init();
+        ResourceManager resources;
+        resources.init(threadPool);
+
+        for (int i = 3; i < argc; i++)
+        {
+            std::string asset = std::string(argv[2]) + "/" + argv[i];
+            if (resources.exportSoftBody(argv[2], atoi(argv[i])))
+            {
+                LOG_WRITE("Converted soft body asset: " + asset);
+            }
+            else
+            {
+                LOG_WARNING("Failed to convert soft body asset: " + asset);
+            }
+        }
+
+        resources.cleanup();
+        threadPool.cleanup();
+        return 0;
+    }
+
+    // Load time benchmarks: bench [name]...
+    if (argc > 1 && std::string(argv[1]) == "bench")
+    {
+        std::vector<std::string> names(argv + 2, argv + argc);
+        if (names.empty())
+            names = { "dragon", "armadillo" };
+
+        Benchmark benchmark;
+        benchmark.run(names);
+        return 0;
+    }
+
     srand((unsigned int)time(0));
     s_window.init("softbody simulation", 1280, 720);
     s_renderer.init(s_window);
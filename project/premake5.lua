@@ -55,7 +55,10 @@ project "project"
     local function compile_shaders()
         commands = {}
         for _, file in ipairs(os.matchfiles("shaders/**")) do
-            table.insert(commands, "glslangValidator -V -o assets/spv/" .. string.sub(file, string.find(file, "/[^/]*$") + 1) .. ".spv " .. file)
+            -- Shared declarations are only compiled as part of the shaders including them
+            if not string.find(file, "^shaders/include/") then
+                table.insert(commands, "glslangValidator -V -Ishaders/include -o assets/spv/" .. string.sub(file, string.find(file, "/[^/]*$") + 1) .. ".spv " .. file)
+            end
         end
         return commands
     end
@@ -0,0 +1,18 @@
+// Entry of the body table written by the renderer each frame, matches BatchedBody. The ranges locate the body in the
+// soft body pool, edges and tetrahedra are shared by every instance of a model. Batched dispatches run one row of workgroups per body
+struct Body
+{
+    uint particleOffset;
+    uint particleCount;
+    uint edgeOffset;
+    uint edgeCount;
+    uint tetOffset;
+    uint tetCount;
+    uint slot;
+    uint subStepCount;
+};
+
+layout(std430, set = 0, binding = 14) buffer BodiesSSBO
+{
+    Body bodies[];
+};
@@ -7,10 +7,12 @@ layout(set = 0, binding = 0) uniform UBO {
 struct Particle
 {
     vec3 position;
+    float invMass;
     vec3 velocity;
+    float padding;
 };
 
-layout(std140, set = 1, binding = 0) readonly buffer ParticlesSSBO
+layout(std430, set = 1, binding = 0) readonly buffer ParticlesSSBO
 {
 	Particle particles[];
 };
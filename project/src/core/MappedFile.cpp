@@ -0,0 +1,99 @@
+#include "pch.h"
+#include "MappedFile.h"
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef WIN32
+bool MappedFile::init(const std::string& path)
+{
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+	{
+		cleanup();
+		return false;
+	}
+	m_size = (size_t)size.QuadPart;
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mapping)
+	{
+		cleanup();
+		return false;
+	}
+
+	m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_data)
+	{
+		cleanup();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::cleanup()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file)
+		CloseHandle(m_file);
+
+	m_data = nullptr;
+	m_mapping = nullptr;
+	m_file = nullptr;
+	m_size = 0;
+}
+#else
+bool MappedFile::init(const std::string& path)
+{
+	m_file = open(path.c_str(), O_RDONLY);
+	if (m_file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(m_file, &info) != 0 || info.st_size == 0)
+	{
+		cleanup();
+		return false;
+	}
+	m_size = (size_t)info.st_size;
+
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (data == MAP_FAILED)
+	{
+		cleanup();
+		return false;
+	}
+	m_data = data;
+	return true;
+}
+
+void MappedFile::cleanup()
+{
+	if (m_data)
+		munmap((void*)m_data, m_size);
+	if (m_file >= 0)
+		close(m_file);
+
+	m_data = nullptr;
+	m_file = -1;
+	m_size = 0;
+}
+#endif
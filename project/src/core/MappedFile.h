@@ -0,0 +1,24 @@
+#pragma once
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+private:
+	const void* m_data = nullptr;
+	size_t m_size = 0;
+
+#ifdef WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#else
+	int m_file = -1;
+#endif
+public:
+	// Returns false if the file could not be opened or mapped
+	bool init(const std::string& path);
+	void cleanup();
+
+	inline const void* getData() const { return m_data; }
+	inline size_t getSize() const { return m_size; }
+	inline bool isOpen() const { return m_data != nullptr; }
+};
@@ -0,0 +1,62 @@
+#include "pch.h"
+#include "RadixSort.h"
+#include "ThreadPool.h"
+
+static const uint32_t RADIX = 256;
+static const uint32_t MIN_CHUNK_SIZE = 16384;
+
+void radixSort(std::vector<uint64_t>& keys, ThreadPool& threadPool, uint32_t firstBit)
+{
+	uint32_t count = (uint32_t)keys.size();
+	uint32_t chunkCount = std::max(std::min(threadPool.getThreadCount(), count / MIN_CHUNK_SIZE), 1u);
+	uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+	std::vector<uint64_t> chunkMasks(chunkCount, 0);
+	threadPool.parallelFor(chunkCount, 1, [&](uint32_t chunk, uint32_t)
+	{
+		for (uint32_t i = chunk * chunkSize, end = std::min(i + chunkSize, count); i < end; i++)
+			chunkMasks[chunk] |= keys[i];
+	});
+	uint64_t mask = 0;
+	for (auto chunkMask : chunkMasks)
+		mask |= chunkMask;
+
+	std::vector<uint64_t> sorted(count);
+	std::vector<uint32_t> offsets(chunkCount * RADIX);
+
+	for (uint32_t shift = firstBit & ~7u; shift < 64; shift += 8)
+	{
+		if (((mask >> shift) & 0xFF) == 0)
+			continue;
+
+		// Histogram per chunk
+		std::fill(offsets.begin(), offsets.end(), 0);
+		threadPool.parallelFor(chunkCount, 1, [&](uint32_t chunk, uint32_t)
+		{
+			uint32_t* histogram = &offsets[chunk * RADIX];
+			for (uint32_t i = chunk * chunkSize, end = std::min(i + chunkSize, count); i < end; i++)
+				histogram[(keys[i] >> shift) & 0xFF]++;
+		});
+
+		// Exclusive scan ordered by digit then chunk keeps the sort stable
+		uint32_t start = 0;
+		for (uint32_t digit = 0; digit < RADIX; digit++)
+		{
+			for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				uint32_t digitCount = offsets[chunk * RADIX + digit];
+				offsets[chunk * RADIX + digit] = start;
+				start += digitCount;
+			}
+		}
+
+		threadPool.parallelFor(chunkCount, 1, [&](uint32_t chunk, uint32_t)
+		{
+			uint32_t* offset = &offsets[chunk * RADIX];
+			for (uint32_t i = chunk * chunkSize, end = std::min(i + chunkSize, count); i < end; i++)
+				sorted[offset[(keys[i] >> shift) & 0xFF]++] = keys[i];
+		});
+
+		keys.swap(sorted);
+	}
+}
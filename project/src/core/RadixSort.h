@@ -0,0 +1,8 @@
+#pragma once
+
+class ThreadPool;
+
+// Parallel LSD radix sort of 64 bit keys, 8 bits per pass. Bytes that are zero in every key are skipped,
+// so keys that only use their low bits are cheap to sort. Bits below firstBit are not sorted,
+// keys that only differ in them keep their input order
+void radixSort(std::vector<uint64_t>& keys, ThreadPool& threadPool, uint32_t firstBit = 0);
@@ -1,69 +1,59 @@
 #include "pch.h"
 #include "SpatialHash.h"
+#include "ThreadPool.h"
+#include "RadixSort.h"
 
-glm::ivec3 SpatialHash::intPos(glm::vec3 pos)
+glm::ivec3 SpatialHash::intPos(glm::vec3 pos) const
 {
 	return glm::floor(pos / m_spacing);
 }
 
-uint32_t SpatialHash::hashPos(glm::vec3 pos)
+uint32_t SpatialHash::hashCell(glm::ivec3 p) const
 {
-	glm::ivec3 p = intPos(pos);
 	return std::abs((p.x * 92837111) ^ (p.y * 689287499) ^ (p.z * 283923481)) % m_tableSize; // Fantasy function (from https://github.com/matthias-research/pages/blob/master/tenMinutePhysics/11-hashing.html) 
 }
 
-void SpatialHash::init(float spacing, std::vector<glm::vec3> positions)
+uint32_t SpatialHash::hashPos(glm::vec3 pos) const
 {
-	uint32_t count = (uint32_t)positions.size();
+	return hashCell(intPos(pos));
+}
 
+void SpatialHash::init(float spacing, const glm::vec3* positions, uint32_t count, ThreadPool& threadPool)
+{
 	m_spacing = spacing;
-	m_tableSize = 2 * count;
+	m_tableSize = std::max(2 * count, 1u);
 	m_cellStart.resize(m_tableSize + 1);
 	m_cellEntries.resize(count);
 
-	for (uint32_t i = 0; i < count; i++)
-		m_cellStart[hashPos(positions[i])]++;
+	// (cell << 32 | point), the points are already in order so only the cell bits need sorting
+	std::vector<uint64_t> keys(count);
+	threadPool.parallelFor(count, 4096, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+			keys[i] = ((uint64_t)hashPos(positions[i]) << 32) | i;
+	});
+	radixSort(keys, threadPool, 32);
 
-	uint32_t start = 0;
-	for (uint32_t i = 0; i < m_tableSize; i++)
+	// Each key starts every cell after the previous key's cell up to its own, so every cell start is written exactly once
+	threadPool.parallelFor(count, 4096, [&](uint32_t begin, uint32_t end)
 	{
-		start += m_cellStart[i];
-		m_cellStart[i] = start;
-	}
-	m_cellStart.back() = start;
+		for (uint32_t i = begin; i < end; i++)
+		{
+			uint32_t cell = (uint32_t)(keys[i] >> 32);
+			uint32_t firstCell = i > 0 ? (uint32_t)(keys[i - 1] >> 32) + 1 : 0;
+			for (uint32_t j = firstCell; j <= cell; j++)
+				m_cellStart[j] = i;
+			m_cellEntries[i] = (uint32_t)keys[i];
+		}
+	});
 
-	for (uint32_t i = 0; i < count; i++)
-		m_cellEntries[--m_cellStart[hashPos(positions[i])]] = i;
+	uint32_t lastCell = count > 0 ? (uint32_t)(keys.back() >> 32) + 1 : 0;
+	std::fill(m_cellStart.begin() + lastCell, m_cellStart.end(), count);
 }
 
-std::vector<uint32_t> SpatialHash::query(glm::vec3 pos, float maxDist)
+std::vector<uint32_t> SpatialHash::query(glm::vec3 pos, float maxDist) const
 {
-	glm::ivec3 p0 = intPos(pos - maxDist);
-	glm::ivec3 p1 = intPos(pos + maxDist);
-
 	std::vector<uint32_t> queries;
-	std::set<uint32_t> usedIds;
-
-	for (int x = p0.x; x <= p1.x; x++)
-	{
-		for (int y = p0.y; y <= p1.y; y++)
-		{
-			for (int z = p0.z; z <= p1.z; z++)
-			{
-				uint32_t id = hashPos(glm::vec3(x, y, z) * m_spacing);
-				if (!usedIds.count(id))
-				{
-					uint32_t start = m_cellStart[id];
-					uint32_t end = m_cellStart[id + 1];
-					for (uint32_t i = start; i < end; i++)
-						queries.push_back(m_cellEntries[i]);
-
-					usedIds.insert(id);
-				}
-
-			}
-		}
-	}
+	forEachInRadius(pos, maxDist, [&](uint32_t id) { queries.push_back(id); });
 	return queries;
 }
-
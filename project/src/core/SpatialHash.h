@@ -1,20 +1,69 @@
 #pragma once
 
-
+class ThreadPool;
 
 class SpatialHash
 {
 private:
+	// Buckets of a query are gathered on the stack, larger queries fall back to the heap
+	const static int MAX_STACK_CELLS = 64;
+
 	float m_spacing;
 	uint32_t m_tableSize;
 	std::vector<uint32_t> m_cellStart;
 	std::vector<uint32_t> m_cellEntries;
 
-	glm::ivec3 intPos(glm::vec3 pos);
-	uint32_t hashPos(glm::vec3 pos);
+	glm::ivec3 intPos(glm::vec3 pos) const;
+	uint32_t hashCell(glm::ivec3 cell) const;
+	uint32_t hashPos(glm::vec3 pos) const;
 public:
-	void init(float spacing, std::vector<glm::vec3> positions);
+	// Built in parallel: keys are hashed per point, radix sorted by cell, then the cell starts are read off the sorted keys.
+	// Entries of a cell are in ascending point order
+	void init(float spacing, const glm::vec3* positions, uint32_t count, ThreadPool& threadPool);
 
-	std::vector<uint32_t> query(glm::vec3 pos, float maxDist);
+	// Calls function(id) for every point in the cells overlapping [pos - maxDist, pos + maxDist], in bucket order.
+	// Cells sharing a bucket are only visited once, points are not distance tested. Only queries spanning more than
+	// MAX_STACK_CELLS cells allocate
+	template<typename F>
+	void forEachInRadius(glm::vec3 pos, float maxDist, F&& function) const;
+
+	std::vector<uint32_t> query(glm::vec3 pos, float maxDist) const;
 };
 
+template<typename F>
+inline void SpatialHash::forEachInRadius(glm::vec3 pos, float maxDist, F&& function) const
+{
+	glm::ivec3 p0 = intPos(pos - maxDist);
+	glm::ivec3 p1 = intPos(pos + maxDist);
+	glm::ivec3 extent = p1 - p0 + 1;
+	size_t cellCount = (size_t)extent.x * extent.y * extent.z;
+
+	uint32_t stackBuckets[MAX_STACK_CELLS];
+	std::vector<uint32_t> heapBuckets;
+	uint32_t* buckets = stackBuckets;
+	if (cellCount > MAX_STACK_CELLS)
+	{
+		heapBuckets.resize(cellCount);
+		buckets = heapBuckets.data();
+	}
+
+	uint32_t* bucketsEnd = buckets;
+	for (int x = p0.x; x <= p1.x; x++)
+	{
+		for (int y = p0.y; y <= p1.y; y++)
+		{
+			for (int z = p0.z; z <= p1.z; z++)
+				*bucketsEnd++ = hashCell(glm::ivec3(x, y, z));
+		}
+	}
+
+	// Cells sharing a bucket end up next to each other
+	std::sort(buckets, bucketsEnd);
+	bucketsEnd = std::unique(buckets, bucketsEnd);
+
+	for (uint32_t* id = buckets; id != bucketsEnd; id++)
+	{
+		for (uint32_t i = m_cellStart[*id], end = m_cellStart[*id + 1]; i < end; i++)
+			function(m_cellEntries[i]);
+	}
+}
@@ -0,0 +1,118 @@
+#include "pch.h"
+#include "ThreadPool.h"
+
+struct ParallelForState
+{
+	const std::function<void(uint32_t, uint32_t)>* function;
+	uint32_t count;
+	uint32_t chunkSize;
+	uint32_t chunkCount;
+
+	std::atomic<uint32_t> nextChunk{ 0 };
+	std::atomic<uint32_t> doneChunks{ 0 };
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	void process()
+	{
+		uint32_t chunk;
+		while ((chunk = nextChunk.fetch_add(1)) < chunkCount)
+		{
+			uint32_t begin = chunk * chunkSize;
+			(*function)(begin, std::min(begin + chunkSize, count));
+
+			if (doneChunks.fetch_add(1) + 1 == chunkCount)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				condition.notify_all();
+			}
+		}
+	}
+};
+
+void ThreadPool::worker()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+			if (m_stop && m_tasks.empty())
+				return;
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ThreadPool::init(uint32_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	m_stop = false;
+	for (uint32_t i = 1; i < threadCount; i++)
+		m_threads.emplace_back(&ThreadPool::worker, this);
+}
+
+void ThreadPool::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_condition.notify_all();
+
+	for (auto& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+	if (m_threads.empty())
+	{
+		task();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	m_condition.notify_one();
+}
+
+void ThreadPool::parallelFor(uint32_t count, uint32_t chunkSize, const std::function<void(uint32_t, uint32_t)>& function)
+{
+	if (count == 0)
+		return;
+
+	chunkSize = std::max(chunkSize, 1u);
+	uint32_t chunkCount = (count + chunkSize - 1) / chunkSize;
+	if (chunkCount == 1 || m_threads.empty())
+	{
+		for (uint32_t begin = 0; begin < count; begin += chunkSize)
+			function(begin, std::min(begin + chunkSize, count));
+		return;
+	}
+
+	// Helpers may start after all chunks are done, the shared state keeps them valid
+	std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+	state->function = &function;
+	state->count = count;
+	state->chunkSize = chunkSize;
+	state->chunkCount = chunkCount;
+
+	uint32_t helperCount = std::min((uint32_t)m_threads.size(), chunkCount - 1);
+	for (uint32_t i = 0; i < helperCount; i++)
+		submit([state]() { state->process(); });
+
+	state->process();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->condition.wait(lock, [&]() { return state->doneChunks.load() == chunkCount; });
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <future>
+
+class ThreadPool
+{
+private:
+	std::vector<std::thread> m_threads;
+	std::deque<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stop = false;
+
+	void worker();
+public:
+	// A thread count of 0 uses one worker per hardware thread, minus the calling thread
+	void init(uint32_t threadCount = 0);
+	void cleanup();
+
+	// Runs the task on a worker, or directly if there are no workers
+	void submit(std::function<void()> task);
+
+	template<typename F>
+	auto async(F&& function) -> std::future<decltype(function())>;
+
+	// Calls function(begin, end) for chunks of [0, count) and returns once all chunks are done.
+	// The calling thread processes chunks as well, so this is safe to call from within a task
+	void parallelFor(uint32_t count, uint32_t chunkSize, const std::function<void(uint32_t, uint32_t)>& function);
+
+	// Worker threads plus the calling thread
+	inline uint32_t getThreadCount() const { return (uint32_t)m_threads.size() + 1; }
+};
+
+template<typename F>
+inline auto ThreadPool::async(F&& function) -> std::future<decltype(function())>
+{
+	auto task = std::make_shared<std::packaged_task<decltype(function())()>>(std::forward<F>(function));
+	std::future<decltype(function())> future = task->get_future();
+	submit([task]() { (*task)(); });
+	return future;
+}
@@ -0,0 +1,691 @@
+#include "pch.h"
+#include "Benchmark.h"
+#include "resources/MeshOptimizer.h"
+#include "core/SpatialHash.h"
+
+#include <numeric>
+
+// Set associative LRU cache with the line size of a gpu L1, fed with the particle reads of the constraint passes
+static const uint32_t CACHE_LINE_SIZE = 128;
+static const uint32_t CACHE_SET_COUNT = 64;
+static const uint32_t CACHE_WAY_COUNT = 4;
+static const uint32_t PBD_POSITION_STRIDE = 32; // (predict, delta) as laid out in the pbd shaders
+
+struct CacheModel
+{
+	std::vector<uint64_t> tags = std::vector<uint64_t>(CACHE_SET_COUNT * CACHE_WAY_COUNT, UINT64_MAX);
+	std::vector<uint64_t> lastUse = std::vector<uint64_t>(CACHE_SET_COUNT * CACHE_WAY_COUNT, 0);
+	uint64_t hits = 0;
+	uint64_t accesses = 0;
+
+	void access(uint64_t address)
+	{
+		uint64_t line = address / CACHE_LINE_SIZE;
+		uint32_t set = (uint32_t)(line % CACHE_SET_COUNT) * CACHE_WAY_COUNT;
+		uint32_t victim = set;
+		accesses++;
+
+		for (uint32_t way = set; way < set + CACHE_WAY_COUNT; way++)
+		{
+			if (tags[way] == line)
+			{
+				hits++;
+				lastUse[way] = accesses;
+				return;
+			}
+			if (lastUse[way] < lastUse[victim])
+				victim = way;
+		}
+		tags[victim] = line;
+		lastUse[victim] = accesses;
+	}
+
+	inline uint64_t getMissBytes() { return (accesses - hits) * CACHE_LINE_SIZE; }
+};
+
+static float cacheHitRate(const TetrahedralMeshData& mesh)
+{
+	CacheModel cache;
+	for (auto& edge : mesh.edges)
+	{
+		cache.access((uint64_t)edge.indices.x * PBD_POSITION_STRIDE);
+		cache.access((uint64_t)edge.indices.y * PBD_POSITION_STRIDE);
+	}
+	for (auto& tet : mesh.tets)
+	{
+		for (int i = 0; i < 4; i++)
+			cache.access((uint64_t)tet.indices[i] * PBD_POSITION_STRIDE);
+	}
+	return cache.hits / (float)cache.accesses;
+}
+
+// Particle buffer layouts of the pbd shaders, before and after packing them as std430 vec4 pairs
+struct ParticleLayout
+{
+	const char* name;
+	uint32_t particleStride;
+	uint32_t positionStride;
+	uint32_t invMassOffset; // Offset of the inverse mass in the particle, unused when the constraints read it next to the prediction
+	bool invMassInPositions;
+};
+
+static const ParticleLayout PARTICLE_LAYOUTS[2] = {
+	{ "std140", 48, 32, 32, false },
+	{ "std430", (uint32_t)sizeof(Particle), (uint32_t)sizeof(PbdPositions), 0, true }
+};
+
+// Bytes moved by one substep of the atomic solve, without the collision constraints which depend on the scene.
+// Streaming kernels read and write every line of the buffers they touch, the gathers of the constraint kernels
+// go through the cache model and their delta atomics land on the lines of the predictions
+static uint64_t substepTraffic(const TetrahedralMeshData& mesh, const ParticleLayout& layout)
+{
+	const uint64_t PARTICLE_BASE = 1ull << 40;
+	uint64_t particleCount = mesh.particles.size();
+
+	// Presolve and postsolve touch both buffers, the sdf and primitive passes only the predictions
+	uint64_t bytes = 2 * 2 * particleCount * (layout.particleStride + layout.positionStride);
+	bytes += 2 * 2 * particleCount * layout.positionStride;
+
+	auto gather = [&](CacheModel& cache, uint32_t particle)
+	{
+		cache.access((uint64_t)particle * layout.positionStride);
+		if (!layout.invMassInPositions)
+			cache.access(PARTICLE_BASE + (uint64_t)particle * layout.particleStride + layout.invMassOffset);
+	};
+
+	CacheModel edgeCache;
+	for (auto& edge : mesh.edges)
+	{
+		gather(edgeCache, edge.indices.x);
+		gather(edgeCache, edge.indices.y);
+	}
+	CacheModel tetCache;
+	for (auto& tet : mesh.tets)
+	{
+		for (int i = 0; i < 4; i++)
+			gather(tetCache, tet.indices[i]);
+	}
+	bytes += edgeCache.getMissBytes() + tetCache.getMissBytes();
+	bytes += mesh.edges.size() * sizeof(Edge) + mesh.tets.size() * sizeof(Tetrahedral);
+	return bytes;
+}
+
+// Same gather/scatter pattern as the stretch and volume constraint shaders
+static void projectConstraints(const TetrahedralMeshData& mesh, const std::vector<glm::vec3>& positions, std::vector<glm::vec3>& deltas)
+{
+	for (auto& edge : mesh.edges)
+	{
+		glm::vec3 dir = positions[edge.indices.y] - positions[edge.indices.x];
+		float len = glm::length(dir);
+		if (len == 0.0f)
+			continue;
+
+		glm::vec3 correction = dir * ((len - edge.restLen) * 0.5f / len);
+		deltas[edge.indices.x] += correction;
+		deltas[edge.indices.y] -= correction;
+	}
+	for (auto& tet : mesh.tets)
+	{
+		glm::uvec4 ids = tet.indices;
+		glm::vec3 p0 = positions[ids.x];
+		glm::vec3 grads[4];
+		grads[1] = glm::cross(positions[ids.w] - p0, positions[ids.z] - p0) / 6.0f;
+		grads[2] = glm::cross(positions[ids.y] - p0, positions[ids.w] - p0) / 6.0f;
+		grads[3] = glm::cross(positions[ids.z] - p0, positions[ids.y] - p0) / 6.0f;
+		grads[0] = -(grads[1] + grads[2] + grads[3]);
+
+		float volume = glm::dot(glm::cross(positions[ids.y] - p0, positions[ids.z] - p0), positions[ids.w] - p0) / 6.0f;
+		float scale = (tet.restVolume - volume) * 0.01f;
+		for (int i = 0; i < 4; i++)
+			deltas[ids[i]] += grads[i] * scale;
+	}
+}
+
+// One pass of the stretch and volume shaders with zero compliance, constraints are visited through the given orders.
+// The first edgesInPlace edges and tetsInPlace tets of the orders are applied in place, which matches the coloured solve as
+// colours share no particles. The rest accumulate and get a fifth applied like postsolve
+static void solveConstraints(
+	const TetrahedralMeshData& mesh,
+	const std::vector<uint32_t>& edgeOrder,
+	const std::vector<uint32_t>& tetOrder,
+	uint32_t edgesInPlace,
+	uint32_t tetsInPlace,
+	std::vector<glm::vec3>& positions,
+	std::vector<glm::vec3>& deltas)
+{
+	static const glm::uvec3 FACE_INDICES[4] = { { 1, 3, 2 }, { 0, 2, 3 }, { 0, 3, 1 }, { 0, 1, 2 } };
+	std::fill(deltas.begin(), deltas.end(), glm::vec3(0.0f));
+
+	for (uint32_t i = 0, count = (uint32_t)edgeOrder.size(); i < count; i++)
+	{
+		const Edge& edge = mesh.edges[edgeOrder[i]];
+		std::vector<glm::vec3>& target = i < edgesInPlace ? positions : deltas;
+		float w0 = mesh.particles[edge.indices.x].invMass;
+		float w1 = mesh.particles[edge.indices.y].invMass;
+		glm::vec3 diff = positions[edge.indices.x] - positions[edge.indices.y];
+		float len = glm::length(diff);
+		if (w0 + w1 == 0.0f || len == 0.0f)
+			continue;
+
+		float correction = -(len - edge.restLen) / (w0 + w1);
+		target[edge.indices.x] += diff / len * correction * w0;
+		target[edge.indices.y] -= diff / len * correction * w1;
+	}
+	for (uint32_t i = 0, count = (uint32_t)tetOrder.size(); i < count; i++)
+	{
+		const Tetrahedral& tet = mesh.tets[tetOrder[i]];
+		std::vector<glm::vec3>& target = i < tetsInPlace ? positions : deltas;
+		glm::uvec4 ids = tet.indices;
+		glm::vec3 normals[4];
+		float w = 0.0f;
+		for (int j = 0; j < 4; j++)
+		{
+			glm::vec3 p0 = positions[ids[FACE_INDICES[j].x]];
+			normals[j] = glm::cross(positions[ids[FACE_INDICES[j].y]] - p0, positions[ids[FACE_INDICES[j].z]] - p0);
+			w += glm::dot(normals[j], normals[j]) * mesh.particles[ids[j]].invMass;
+		}
+		if (w == 0.0f)
+			continue;
+
+		glm::vec3 p0 = positions[ids.x];
+		float volume = glm::dot(glm::cross(positions[ids.y] - p0, positions[ids.z] - p0), positions[ids.w] - p0) / 6.0f;
+		float correction = -(volume - tet.restVolume) / w;
+		for (int j = 0; j < 4; j++)
+			target[ids[j]] += normals[j] * correction * mesh.particles[ids[j]].invMass;
+	}
+
+	for (size_t i = 0, len = positions.size(); i < len; i++)
+		positions[i] += deltas[i] * 0.2f;
+}
+
+// Root mean square of the relative edge length error
+static float stretchResidual(const TetrahedralMeshData& mesh, const std::vector<glm::vec3>& positions)
+{
+	double sum = 0.0;
+	for (auto& edge : mesh.edges)
+	{
+		float error = glm::length(positions[edge.indices.x] - positions[edge.indices.y]) / edge.restLen - 1.0f;
+		sum += error * error;
+	}
+	return (float)std::sqrt(sum / std::max(mesh.edges.size(), (size_t)1));
+}
+
+// Embedding as done before the tet bvh: every tet tests the vertices in the hash cells around its bounding sphere
+static void embedWithHash(const MeshData& mesh, const TetrahedralMeshData& tetMesh, std::vector<DeformationInfo>& deformationInfo, ThreadPool& threadPool)
+{
+	uint32_t posCount = (uint32_t)mesh.vertices.positions.size();
+	deformationInfo.assign(posCount, DeformationInfo());
+
+	std::vector<glm::vec3> positions(posCount);
+	for (uint32_t i = 0; i < posCount; i++)
+		positions[i] = mesh.vertices.positions[i].vec;
+
+	SpatialHash hash;
+	hash.init(0.25f, positions.data(), posCount, threadPool);
+
+	// Best tet per vertex packed as (distance bits << 32 | tetId). The distance is never negative so its bits order like the float,
+	// taking the minimum keeps the closest tet and the lowest id on ties, which makes the result independent of thread count
+	std::vector<std::atomic<uint64_t>> best(posCount);
+	for (auto& entry : best)
+		entry.store(UINT64_MAX, std::memory_order_relaxed);
+
+	auto tetMatrix = [&](uint32_t tetId)
+	{
+		glm::uvec4 indices = tetMesh.tets[tetId].indices;
+		return glm::inverse(
+			glm::mat3(
+				tetMesh.particles[indices[0]].position - tetMesh.particles[indices[3]].position,
+				tetMesh.particles[indices[1]].position - tetMesh.particles[indices[3]].position,
+				tetMesh.particles[indices[2]].position - tetMesh.particles[indices[3]].position
+			)
+		);
+	};
+
+	// Iterate all tetrahedra
+	threadPool.parallelFor((uint32_t)tetMesh.tets.size(), 256, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			glm::uvec4 indices = tetMesh.tets[i].indices;
+			glm::vec3 tetCenter =
+				(tetMesh.particles[indices[0]].position +
+					tetMesh.particles[indices[1]].position +
+					tetMesh.particles[indices[2]].position +
+					tetMesh.particles[indices[3]].position) * 0.25f;
+
+			float maxRadius = 0.0f;
+			for (int j = 0; j < 4; j++)
+			{
+				glm::vec3 diff = tetMesh.particles[indices[j]].position - tetCenter;
+				maxRadius = std::max(maxRadius, glm::length(diff));
+			}
+			maxRadius += 0.1f;
+
+			glm::mat3 matrix = tetMatrix(i);
+
+			// Visit nearby vertices
+			float maxRadiusSq = maxRadius * maxRadius;
+			hash.forEachInRadius(tetCenter, maxRadius, [&](uint32_t id)
+			{
+				uint64_t current = best[id].load(std::memory_order_relaxed);
+
+				// Already inside a tet with a lower id
+				if ((current >> 32) == 0 && (uint32_t)current < i)
+					return;
+
+				glm::vec3 diff = positions[id] - tetCenter;
+				if (glm::dot(diff, diff) > maxRadiusSq)
+					return;
+
+				diff = positions[id] - tetMesh.particles[indices[3]].position;
+				diff = matrix * diff;
+
+				// Invalid bary coordinates
+				if (isnan(diff.x) || isnan(diff.y) || isnan(diff.z))
+					return;
+
+				float baryCoords[4]{ diff.x, diff.y, diff.z, 1.0f - (diff.x + diff.y + diff.z) };
+				float maxDist = 0.0f;
+				for (int k = 0; k < 4; k++)
+					maxDist = std::max(maxDist, -baryCoords[k]);
+
+				uint32_t distBits;
+				memcpy(&distBits, &maxDist, sizeof(float));
+				uint64_t candidate = ((uint64_t)distBits << 32) | i;
+				while (candidate < current && !best[id].compare_exchange_weak(current, candidate, std::memory_order_relaxed));
+			});
+		}
+	});
+
+	// Weights of the chosen tets, recomputed the same way as during the search
+	threadPool.parallelFor(posCount, 1024, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			uint64_t entry = best[i].load(std::memory_order_relaxed);
+			if (entry == UINT64_MAX)
+				continue;
+
+			uint32_t tetId = (uint32_t)entry;
+			glm::vec3 diff = tetMatrix(tetId) * (positions[i] - tetMesh.particles[tetMesh.tets[tetId].indices[3]].position);
+			deformationInfo[i].tetId = tetId;
+			deformationInfo[i].weights = diff;
+		}
+	});
+}
+
+bool Benchmark::fileExists(const std::string& path)
+{
+	std::ifstream stream(path);
+	return stream.is_open();
+}
+
+void Benchmark::meshLoading(const std::string& name)
+{
+	std::string path = "assets/models/" + name + ".obj";
+	if (!fileExists(path))
+		return;
+
+	MeshData mesh = m_resources.loadMeshOBJ(path, false);
+	if (!mesh.vertices.positions.size())
+		return;
+
+	float time = measure([&]() { mesh = m_resources.loadMeshOBJ(path, false); });
+	LOG_WRITE(
+		"[mesh] " + name + 
+		": " + std::to_string(mesh.indices.size()) + " indices -> " + std::to_string(mesh.vertices.positions.size()) + " vertices" +
+		", " + std::to_string(time * 1000.0f) + " ms" +
+		", " + std::to_string(mesh.indices.size() / time / 1000000.0f) + " M indices/s"
+	);
+}
+
+void Benchmark::vertexCache(const std::string& name)
+{
+	std::string path = "assets/models/" + name + ".obj";
+	if (!fileExists(path))
+		return;
+
+	MeshData original = m_resources.loadMeshOBJ(path, false);
+	if (!original.indices.size())
+		return;
+
+	MeshData optimized;
+	float time = measure([&]() { optimized = original; optimizeMesh(optimized); });
+
+	VertexCacheStats before = analyzeVertexCache(original);
+	VertexCacheStats after = analyzeVertexCache(optimized);
+	LOG_WRITE(
+		"[vertex cache] " + name +
+		": ACMR " + std::to_string(before.acmr) + " -> " + std::to_string(after.acmr) +
+		", ATVR " + std::to_string(before.atvr) + " -> " + std::to_string(after.atvr) +
+		", " + std::to_string(time * 1000.0f) + " ms"
+	);
+}
+
+void Benchmark::edgeExtraction(const std::string& name)
+{
+	for (int resolution : RESOLUTIONS)
+	{
+		std::string path = "assets/tet_models/" + name + "/" + std::to_string(resolution) + ".obj";
+		if (!fileExists(path))
+			continue;
+
+		TetrahedralMeshData mesh = m_resources.loadTetrahedralMeshOBJ(path);
+		if (!mesh.tets.size())
+			continue;
+
+		float time = measure([&]() { m_resources.extractEdges(mesh); });
+		LOG_WRITE(
+			"[edges] " + name + "/" + std::to_string(resolution) +
+			": " + std::to_string(mesh.tets.size()) + " tets -> " + std::to_string(mesh.edges.size()) + " edges" +
+			", " + std::to_string(time * 1000.0f) + " ms" +
+			", " + std::to_string(mesh.tets.size() / time / 1000000.0f) + " M tets/s"
+		);
+	}
+}
+
+void Benchmark::embedding(const std::string& name)
+{
+	std::string meshPath = "assets/models/" + name + ".obj";
+	if (!fileExists(meshPath))
+		return;
+
+	MeshData mesh = m_resources.loadMeshOBJ(meshPath);
+	uint32_t maxThreads = m_threadPool.getThreadCount();
+
+	for (int resolution : RESOLUTIONS)
+	{
+		std::string path = "assets/tet_models/" + name + "/" + std::to_string(resolution) + ".obj";
+		if (resolution == 100 || !fileExists(path))
+			continue;
+
+		TetrahedralMeshData tetMesh = m_resources.loadTetrahedralMeshOBJ(path);
+		std::vector<DeformationInfo> deformationInfo;
+
+		// Thread scaling, powers of two up to the hardware thread count
+		for (uint32_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+		{
+			m_threadPool.cleanup();
+			m_threadPool.init(threads);
+
+			float time = measure([&]() { m_resources.embedMesh(mesh, tetMesh, deformationInfo); });
+			LOG_WRITE(
+				"[embedding] " + name + "/" + std::to_string(resolution) +
+				": " + std::to_string(mesh.vertices.positions.size()) + " vertices, " + std::to_string(tetMesh.tets.size()) + " tets" +
+				", " + std::to_string(threads) + " threads" +
+				", " + std::to_string(time * 1000.0f) + " ms"
+			);
+
+			if (threads == maxThreads)
+				break;
+		}
+
+		std::vector<DeformationInfo> reference;
+		float time = measure([&]() { embedWithHash(mesh, tetMesh, reference, m_threadPool); });
+		bool identical = reference.size() == deformationInfo.size();
+		for (size_t i = 0; identical && i < reference.size(); i++)
+			identical = reference[i].tetId == deformationInfo[i].tetId && reference[i].weights == deformationInfo[i].weights;
+
+		LOG_WRITE(
+			"[embedding] " + name + "/" + std::to_string(resolution) +
+			": spatial hash reference, " + std::to_string(maxThreads) + " threads" +
+			", " + std::to_string(time * 1000.0f) + " ms" +
+			(identical ? ", identical" : ", differs from the bvh")
+		);
+	}
+}
+
+void Benchmark::spatialHashBuild(const std::string& name)
+{
+	std::string path = "assets/models/" + name + ".obj";
+	if (!fileExists(path))
+		return;
+
+	MeshData mesh = m_resources.loadMeshOBJ(path);
+	std::vector<glm::vec3> positions(mesh.vertices.positions.size());
+	for (size_t i = 0; i < positions.size(); i++)
+		positions[i] = mesh.vertices.positions[i].vec;
+
+	uint32_t maxThreads = m_threadPool.getThreadCount();
+	for (uint32_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+	{
+		m_threadPool.cleanup();
+		m_threadPool.init(threads);
+
+		SpatialHash hash;
+		float time = measure([&]() { hash.init(0.25f, positions.data(), (uint32_t)positions.size(), m_threadPool); });
+		LOG_WRITE(
+			"[spatial hash] " + name +
+			": " + std::to_string(positions.size()) + " points" +
+			", " + std::to_string(threads) + " threads" +
+			", " + std::to_string(time * 1000.0f) + " ms" +
+			", " + std::to_string(positions.size() / time / 1000000.0f) + " M points/s"
+		);
+
+		if (threads == maxThreads)
+			break;
+	}
+}
+
+void Benchmark::spatialQueries(const std::string& name)
+{
+	std::string meshPath = "assets/models/" + name + ".obj";
+	if (!fileExists(meshPath))
+		return;
+
+	MeshData mesh = m_resources.loadMeshOBJ(meshPath);
+	std::vector<glm::vec3> positions(mesh.vertices.positions.size());
+	for (size_t i = 0; i < positions.size(); i++)
+		positions[i] = mesh.vertices.positions[i].vec;
+
+	SpatialHash hash;
+	hash.init(0.25f, positions.data(), (uint32_t)positions.size(), m_threadPool);
+
+	for (int resolution : RESOLUTIONS)
+	{
+		std::string path = "assets/tet_models/" + name + "/" + std::to_string(resolution) + ".obj";
+		if (resolution == 100 || !fileExists(path))
+			continue;
+
+		// Same queries as the embedding, one per tet center
+		TetrahedralMeshData tetMesh = m_resources.loadTetrahedralMeshOBJ(path);
+		std::vector<glm::vec4> queries(tetMesh.tets.size());
+		for (size_t i = 0; i < queries.size(); i++)
+		{
+			glm::uvec4 indices = tetMesh.tets[i].indices;
+			glm::vec3 center(0.0f);
+			for (int j = 0; j < 4; j++)
+				center += tetMesh.particles[indices[j]].position * 0.25f;
+
+			float radius = 0.0f;
+			for (int j = 0; j < 4; j++)
+				radius = std::max(radius, glm::length(tetMesh.particles[indices[j]].position - center));
+			queries[i] = glm::vec4(center, radius + 0.1f);
+		}
+		if (!queries.size())
+			continue;
+
+		uint64_t vectorSum = 0;
+		uint64_t visitorSum = 0;
+		float vectorTime = measure([&]()
+		{
+			for (auto& query : queries)
+			{
+				for (uint32_t id : hash.query(glm::vec3(query), query.w))
+					vectorSum += id;
+			}
+		});
+		float visitorTime = measure([&]()
+		{
+			for (auto& query : queries)
+				hash.forEachInRadius(glm::vec3(query), query.w, [&](uint32_t id) { visitorSum += id; });
+		});
+
+		if (vectorSum != visitorSum)
+			LOG_WARNING("Spatial hash query APIs disagree for " + name + "/" + std::to_string(resolution));
+
+		LOG_WRITE(
+			"[spatial queries] " + name + "/" + std::to_string(resolution) +
+			": " + std::to_string(queries.size()) + " queries" +
+			", query " + std::to_string(queries.size() / vectorTime / 1000000.0f) + " M queries/s" +
+			", forEachInRadius " + std::to_string(queries.size() / visitorTime / 1000000.0f) + " M queries/s"
+		);
+	}
+}
+
+void Benchmark::constraintLocality(const std::string& name)
+{
+	for (int resolution : RESOLUTIONS)
+	{
+		std::string path = "assets/tet_models/" + name + "/" + std::to_string(resolution) + ".obj";
+		if (!fileExists(path))
+			continue;
+
+		TetrahedralMeshData meshes[2];
+		meshes[0] = m_resources.loadTetrahedralMeshOBJ(path);
+		if (!meshes[0].tets.size())
+			continue;
+
+		std::vector<uint32_t> particleRemap;
+		meshes[1] = meshes[0];
+		m_resources.reorderTetrahedralMesh(meshes[1], particleRemap);
+
+		const char* labels[2] = { "obj order", "reordered" };
+		for (int i = 0; i < 2; i++)
+		{
+			std::vector<glm::vec3> positions(meshes[i].particles.size());
+			for (size_t j = 0; j < positions.size(); j++)
+				positions[j] = meshes[i].particles[j].position;
+			std::vector<glm::vec3> deltas(positions.size(), glm::vec3(0.0f));
+
+			float time = measure([&]() { projectConstraints(meshes[i], positions, deltas); });
+			size_t constraintCount = meshes[i].edges.size() + meshes[i].tets.size();
+			LOG_WRITE(
+				"[locality] " + name + "/" + std::to_string(resolution) + " " + labels[i] +
+				": " + std::to_string(cacheHitRate(meshes[i]) * 100.0f) + " % cache hits" +
+				", " + std::to_string(time * 1000.0f) + " ms" +
+				", " + std::to_string(constraintCount / time / 1000000.0f) + " M constraints/s"
+			);
+		}
+	}
+}
+
+void Benchmark::particleBandwidth(const std::string& name)
+{
+	for (int resolution : RESOLUTIONS)
+	{
+		std::string path = "assets/tet_models/" + name + "/" + std::to_string(resolution) + ".obj";
+		if (!fileExists(path))
+			continue;
+
+		TetrahedralMeshData mesh = m_resources.loadTetrahedralMeshOBJ(path);
+		if (!mesh.tets.size())
+			continue;
+
+		std::vector<uint32_t> particleRemap;
+		m_resources.reorderTetrahedralMesh(mesh, particleRemap);
+
+		uint64_t bytes[2];
+		for (int i = 0; i < 2; i++)
+			bytes[i] = substepTraffic(mesh, PARTICLE_LAYOUTS[i]);
+
+		LOG_WRITE(
+			"[bandwidth] " + name + "/" + std::to_string(resolution) +
+			": " + PARTICLE_LAYOUTS[0].name + " " + std::to_string(bytes[0] / 1024.0f) + " KB per substep" +
+			", " + PARTICLE_LAYOUTS[1].name + " " + std::to_string(bytes[1] / 1024.0f) + " KB per substep" +
+			" (" + std::to_string(100.0f - bytes[1] * 100.0f / bytes[0]) + " % less)"
+		);
+	}
+}
+
+void Benchmark::constraintColoring(const std::string& name)
+{
+	static const int SOLVE_ITERATION_COUNT = 20;
+
+	for (int resolution : RESOLUTIONS)
+	{
+		std::string path = "assets/tet_models/" + name + "/" + std::to_string(resolution) + ".obj";
+		if (!fileExists(path))
+			continue;
+
+		TetrahedralMeshData mesh = m_resources.loadTetrahedralMeshOBJ(path);
+		if (!mesh.tets.size())
+			continue;
+
+		std::vector<uint32_t> particleRemap;
+		m_resources.reorderTetrahedralMesh(mesh, particleRemap);
+
+		float time = measure([&]() { m_resources.colorConstraints(mesh); });
+
+		uint32_t edgeColorCount = (uint32_t)mesh.edgeColorOffsets.size() - 2;
+		uint32_t tetColorCount = (uint32_t)mesh.tetColorOffsets.size() - 2;
+		uint32_t coloredEdges = mesh.edgeColorOffsets[edgeColorCount];
+		uint32_t coloredTets = mesh.tetColorOffsets[tetColorCount];
+
+		LOG_WRITE(
+			"[coloring] " + name + "/" + std::to_string(resolution) +
+			": " + std::to_string(edgeColorCount) + " edge colours (" + std::to_string(mesh.edges.size() - coloredEdges) + " uncoloured edges)" +
+			", " + std::to_string(tetColorCount) + " tet colours (" + std::to_string(mesh.tets.size() - coloredTets) + " uncoloured tets)" +
+			", " + std::to_string(time * 1000.0f) + " ms"
+		);
+
+		// Jacobi visits the constraints in mesh order, both start from the rest shape scaled by 1.5
+		std::vector<uint32_t> edgeOrder(mesh.edges.size());
+		std::vector<uint32_t> tetOrder(mesh.tets.size());
+		std::iota(edgeOrder.begin(), edgeOrder.end(), 0);
+		std::iota(tetOrder.begin(), tetOrder.end(), 0);
+
+		const char* labels[2] = { "jacobi", "coloured" };
+		const std::vector<uint32_t>* edgeOrders[2] = { &edgeOrder, &mesh.edgeColorOrder };
+		const std::vector<uint32_t>* tetOrders[2] = { &tetOrder, &mesh.tetColorOrder };
+		uint32_t inPlace[2][2] = { { 0, 0 }, { coloredEdges, coloredTets } };
+		uint32_t dispatchCounts[2] = {
+			2,
+			edgeColorCount + tetColorCount + (coloredEdges < mesh.edges.size()) + (coloredTets < mesh.tets.size())
+		};
+		for (int i = 0; i < 2; i++)
+		{
+			std::vector<glm::vec3> positions(mesh.particles.size());
+			std::vector<glm::vec3> deltas(positions.size());
+
+			float solveTime = measure([&]()
+			{
+				for (size_t j = 0; j < positions.size(); j++)
+					positions[j] = mesh.particles[j].position * 1.5f;
+				for (int j = 0; j < SOLVE_ITERATION_COUNT; j++)
+					solveConstraints(mesh, *edgeOrders[i], *tetOrders[i], inPlace[i][0], inPlace[i][1], positions, deltas);
+			});
+
+			LOG_WRITE(
+				"[coloring] " + name + "/" + std::to_string(resolution) + " " + labels[i] +
+				": stretch residual " + std::to_string(stretchResidual(mesh, positions)) +
+				" after " + std::to_string(SOLVE_ITERATION_COUNT) + " passes" +
+				", " + std::to_string(dispatchCounts[i]) + " dispatches per pass" +
+				", " + std::to_string(solveTime * 1000.0f / SOLVE_ITERATION_COUNT) + " ms per pass"
+			);
+		}
+	}
+}
+
+void Benchmark::run(const std::vector<std::string>& names)
+{
+	m_threadPool.init();
+	m_resources.init(m_threadPool);
+	LOG_WRITE("Benchmark threads: " + std::to_string(m_threadPool.getThreadCount()));
+
+	for (auto& name : names)
+	{
+		meshLoading(name);
+		vertexCache(name);
+		edgeExtraction(name);
+		embedding(name);
+		spatialHashBuild(name);
+		spatialQueries(name);
+		constraintLocality(name);
+		particleBandwidth(name);
+		constraintColoring(name);
+	}
+
+	m_resources.cleanup();
+	m_threadPool.cleanup();
+}
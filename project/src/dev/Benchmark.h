@@ -0,0 +1,43 @@
+#pragma once
+
+#include "resources/ResourceManager.h"
+
+// Offline load time benchmarks, run from the project directory with: bench [name]...
+class Benchmark
+{
+private:
+	const static int ITERATION_COUNT = 5;
+	const static int RESOLUTION_COUNT = 6;
+	inline const static int RESOLUTIONS[RESOLUTION_COUNT] = { 1, 5, 10, 25, 50, 100 };
+
+	ThreadPool m_threadPool;
+	ResourceManager m_resources;
+
+	// Average time in seconds of ITERATION_COUNT calls
+	template<typename F>
+	static float measure(F&& function);
+
+	static bool fileExists(const std::string& path);
+
+	void meshLoading(const std::string& name);
+	void vertexCache(const std::string& name);
+	void edgeExtraction(const std::string& name);
+	void embedding(const std::string& name);
+	void spatialHashBuild(const std::string& name);
+	void spatialQueries(const std::string& name);
+	void constraintLocality(const std::string& name);
+	void particleBandwidth(const std::string& name);
+	void constraintColoring(const std::string& name);
+public:
+	void run(const std::vector<std::string>& names);
+};
+
+template<typename F>
+inline float Benchmark::measure(F&& function)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < ITERATION_COUNT; i++)
+		function();
+	std::chrono::duration<float> elapsed = std::chrono::high_resolution_clock::now() - start;
+	return elapsed.count() / ITERATION_COUNT;
+}
@@ -63,6 +63,25 @@ void CommandPool::endSingleTimeCommand(VkCommandBuffer buffer)
     vkFreeCommandBuffers(p_device->getLogical(), m_commandPool, 1, &buffer);
 }
 
+void CommandPool::endSingleTimeCommand(VkCommandBuffer buffer, VkFence fence)
+{
+    vkEndCommandBuffer(buffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &buffer;
+
+    VkQueue queue = m_bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE ? p_device->getComputeQueue() : p_device->getGraphicsQueue();
+    if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
+        LOG_ERROR("Failed to submit single time command buffer!");
+}
+
+void CommandPool::freeCommandBuffer(VkCommandBuffer buffer)
+{
+    vkFreeCommandBuffers(p_device->getLogical(), m_commandPool, 1, &buffer);
+}
+
 void CommandPool::copyBuffer(Buffer& src, Buffer& dst, VkDeviceSize size)
 {
     VkCommandBuffer commandBuffer = beginSingleTimeCommand();
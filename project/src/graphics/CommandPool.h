@@ -17,6 +17,9 @@ public:
 
 	VkCommandBuffer beginSingleTimeCommand();
 	void endSingleTimeCommand(VkCommandBuffer buffer);
+	// Submits without waiting, the fence is signaled once the commands have executed
+	void endSingleTimeCommand(VkCommandBuffer buffer, VkFence fence);
+	void freeCommandBuffer(VkCommandBuffer buffer);
 
 	void copyBuffer(Buffer& src, Buffer& dst, VkDeviceSize size);
 	void copyBufferToImage(Buffer& src, Texture& dst);
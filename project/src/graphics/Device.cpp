@@ -118,10 +118,26 @@ void Device::createLogicalDevice(Instance& instance)
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
+	// Float atomics on shared memory are optional, they are only used by the fused substep kernel
+	VkPhysicalDeviceShaderAtomicFloatFeaturesEXT supportedAtomicFeatures{};
+	supportedAtomicFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_FLOAT_FEATURES_EXT;
+
+	VkPhysicalDeviceFeatures2 supportedFeatures{};
+	supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures.pNext = &supportedAtomicFeatures;
+	vkGetPhysicalDeviceFeatures2(m_physicalDevice, &supportedFeatures);
+	m_sharedFloatAtomics = supportedAtomicFeatures.shaderSharedFloat32AtomicAdd;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+	m_maxComputeSharedMemorySize = properties.limits.maxComputeSharedMemorySize;
+	m_timestampPeriod = properties.limits.timestampComputeAndGraphics ? properties.limits.timestampPeriod : 0.0f;
+
 	VkPhysicalDeviceShaderAtomicFloatFeaturesEXT atomicFeatures = {};
 	atomicFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_FLOAT_FEATURES_EXT;
 	atomicFeatures.shaderBufferFloat32AtomicAdd = VK_TRUE;
 	atomicFeatures.shaderBufferFloat32Atomics = VK_TRUE;
+	atomicFeatures.shaderSharedFloat32AtomicAdd = m_sharedFloatAtomics;
 
 	VkPhysicalDeviceFeatures2 deviceFeatures{};
 	deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
@@ -27,6 +27,11 @@ private:
 
 	QueueFamilyIndices m_indices;
 
+	// Optional capabilities, queried when the logical device is created
+	bool m_sharedFloatAtomics = false;
+	uint32_t m_maxComputeSharedMemorySize = 0;
+	float m_timestampPeriod = 0.0f; // Nanoseconds per timestamp tick, 0 if the queues can't write timestamps
+
 	const std::vector<const char*> c_deviceExtensions = {
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 		VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME,
@@ -53,5 +58,9 @@ public:
 	inline VkQueue getComputeQueue() { return m_computeQueue; }
 	inline QueueFamilyIndices getQueueFamilyIndices() { return m_indices; }
 	inline VkSampleCountFlagBits getMsaaSamples() { return m_msaaSamples; }
+	inline bool supportsSharedFloatAtomics() const { return m_sharedFloatAtomics; }
+	inline uint32_t getMaxComputeSharedMemorySize() const { return m_maxComputeSharedMemorySize; }
+	inline bool supportsTimestamps() const { return m_timestampPeriod > 0.0f; }
+	inline float getTimestampPeriod() const { return m_timestampPeriod; }
 };
 
@@ -0,0 +1,122 @@
+#include "pch.h"
+#include "UploadBatch.h"
+
+void UploadBatch::init(Device& device)
+{
+    p_device = &device;
+    p_commandPool = nullptr;
+    m_blockUsed = 0;
+    m_byteCount = 0;
+    m_commandBuffer = VK_NULL_HANDLE;
+    m_fence = VK_NULL_HANDLE;
+    m_latency = 0.0f;
+    m_complete = false;
+}
+
+void UploadBatch::cleanup()
+{
+    if (m_fence != VK_NULL_HANDLE)
+    {
+        wait();
+        vkDestroyFence(p_device->getLogical(), m_fence, nullptr);
+        p_commandPool->freeCommandBuffer(m_commandBuffer);
+        m_fence = VK_NULL_HANDLE;
+        m_commandBuffer = VK_NULL_HANDLE;
+    }
+
+    for (auto& block : m_blocks)
+    {
+        block.unmap();
+        block.cleanup();
+    }
+    m_blocks.clear();
+    m_copies.clear();
+}
+
+void UploadBatch::add(Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize dstOffset)
+{
+    if (size == 0)
+        return;
+
+    // Open a new block when the current one can't fit the data, large uploads get a block of their own
+    if (m_blocks.empty() || m_blockUsed + size > m_blocks.back().getSize())
+    {
+        m_blocks.push_back(Buffer());
+        m_blocks.back().init(*p_device,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            std::max(BLOCK_SIZE, size)
+        );
+        if (m_blocks.back().map() != VK_SUCCESS)
+            LOG_ERROR("Failed to map staging block!");
+        m_blockUsed = 0;
+    }
+
+    Buffer& block = m_blocks.back();
+    memcpy((char*)block.getMapped() + m_blockUsed, data, size);
+
+    Copy copy{};
+    copy.src = block.get();
+    copy.dst = dst.get();
+    copy.region.srcOffset = m_blockUsed;
+    copy.region.dstOffset = dstOffset;
+    copy.region.size = size;
+    m_copies.push_back(copy);
+
+    m_blockUsed = (m_blockUsed + size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    m_byteCount += size;
+}
+
+void UploadBatch::submit(CommandPool& commandPool)
+{
+    p_commandPool = &commandPool;
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(p_device->getLogical(), &fenceInfo, nullptr, &m_fence) != VK_SUCCESS)
+        LOG_ERROR("Failed to create upload fence!");
+
+    m_commandBuffer = commandPool.beginSingleTimeCommand();
+    for (auto& copy : m_copies)
+        vkCmdCopyBuffer(m_commandBuffer, copy.src, copy.dst, 1, &copy.region);
+
+    // Make the uploads visible to any later use of the buffers, including the compute queue
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    vkCmdPipelineBarrier(m_commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0,
+        1,
+        &memoryBarrier,
+        0,
+        nullptr,
+        0,
+        nullptr);
+
+    m_submitTime = std::chrono::system_clock::now();
+    commandPool.endSingleTimeCommand(m_commandBuffer, m_fence);
+}
+
+bool UploadBatch::isComplete()
+{
+    if (m_complete)
+        return true;
+    if (m_fence == VK_NULL_HANDLE || vkGetFenceStatus(p_device->getLogical(), m_fence) != VK_SUCCESS)
+        return false;
+
+    m_latency = std::chrono::duration<float>(std::chrono::system_clock::now() - m_submitTime).count();
+    m_complete = true;
+    return true;
+}
+
+void UploadBatch::wait()
+{
+    if (m_fence == VK_NULL_HANDLE)
+        return;
+
+    vkWaitForFences(p_device->getLogical(), 1, &m_fence, VK_TRUE, UINT64_MAX);
+    isComplete();
+}
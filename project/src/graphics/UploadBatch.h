@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Device.h"
+#include "Buffer.h"
+#include "CommandPool.h"
+
+// Collects many buffer uploads into one staging arena and copies them all with a single fenced submission.
+// Staging can be filled on any thread, submit and polling must happen on the thread owning the command pool
+class UploadBatch
+{
+private:
+	const static VkDeviceSize BLOCK_SIZE = 4 * 1024 * 1024;
+	const static VkDeviceSize ALIGNMENT = 16;
+
+	struct Copy
+	{
+		VkBuffer src;
+		VkBuffer dst;
+		VkBufferCopy region;
+	};
+
+	Device* p_device;
+	CommandPool* p_commandPool;
+
+	std::vector<Buffer> m_blocks; // Persistently mapped staging blocks
+	VkDeviceSize m_blockUsed;
+	std::vector<Copy> m_copies;
+	VkDeviceSize m_byteCount;
+
+	VkCommandBuffer m_commandBuffer;
+	VkFence m_fence;
+	std::chrono::system_clock::time_point m_submitTime;
+	float m_latency;
+	bool m_complete;
+public:
+	void init(Device& device);
+	void cleanup();
+
+	// Copies data into the staging arena, the copy into dst is recorded on submit
+	void add(Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+	void submit(CommandPool& commandPool);
+	// Polls the fence without blocking
+	bool isComplete();
+	void wait();
+
+	inline bool isSubmitted() { return m_fence != VK_NULL_HANDLE; }
+	inline VkDeviceSize getByteCount() { return m_byteCount; }
+	inline uint32_t getCopyCount() { return (uint32_t)m_copies.size(); }
+	inline float getLatency() { return m_latency; } // Seconds from submit to completion
+};
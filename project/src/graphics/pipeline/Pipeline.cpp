@@ -402,7 +402,8 @@ void Pipeline::initGraphics(
 void Pipeline::initCompute(
     Device& device,
     PipelineLayout& layout,
-    const std::string& shaderPath
+    const std::string& shaderPath,
+    const std::vector<uint32_t>& constants
 )
 {
     p_device = &device;
@@ -411,11 +412,26 @@ void Pipeline::initCompute(
 
     VkShaderModule shaderModule = loadShader(shaderPath);
 
+    std::vector<VkSpecializationMapEntry> mapEntries(constants.size());
+    for (uint32_t i = 0; i < (uint32_t)constants.size(); i++)
+    {
+        mapEntries[i].constantID = i;
+        mapEntries[i].offset = i * sizeof(uint32_t);
+        mapEntries[i].size = sizeof(uint32_t);
+    }
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = (uint32_t)mapEntries.size();
+    specializationInfo.pMapEntries = mapEntries.data();
+    specializationInfo.dataSize = sizeof(uint32_t) * constants.size();
+    specializationInfo.pData = constants.data();
+
     VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
     computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
     computeShaderStageInfo.module = shaderModule;
     computeShaderStageInfo.pName = "main";
+    computeShaderStageInfo.pSpecializationInfo = constants.empty() ? nullptr : &specializationInfo;
 
     VkComputePipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
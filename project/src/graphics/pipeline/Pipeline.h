@@ -57,10 +57,12 @@ public:
 		PipelineSettings settings,
 		VertexStreamInput inputStreams
 	);
+	// constants[i] specializes the uint constant with constant_id i
 	void initCompute(
 		Device& device,
 		PipelineLayout& layout,
-		const std::string& shaderPath
+		const std::string& shaderPath,
+		const std::vector<uint32_t>& constants = {}
 	);
 
 	void cleanup();
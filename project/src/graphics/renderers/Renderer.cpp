@@ -2,6 +2,8 @@
 #include "Renderer.h"
 #include "core/Window.h"
 
+#include <glm/gtc/quaternion.hpp>
+
 void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
     static float orthoSize = 15.0f;
@@ -62,6 +64,17 @@ void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
     m_floorMesh.bind(commandBuffer);
     vkCmdDrawIndexed(commandBuffer, m_floorMesh.getIndexCount(), 1, 0, 0, 0);
 
+    if (m_renderCollider)
+    {
+        m_colliderMesh.bind(commandBuffer);
+        vkCmdDrawIndexed(commandBuffer, m_colliderMesh.getIndexCount(), 1, 0, 0, 0);
+    }
+    if (m_sdfMeshData.indices.size() > 0)
+    {
+        m_sdfMesh.bind(commandBuffer);
+        vkCmdDrawIndexed(commandBuffer, m_sdfMesh.getIndexCount(), 1, 0, 0, 0);
+    }
+
     if (m_renderTetMesh)
     {
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_tetPipeline.get());
@@ -90,33 +103,83 @@ void Renderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
     vkCmdEndRenderPass(commandBuffer);
 }
 
-void Renderer::detectCollisions(VkCommandBuffer commandBuffer, SoftBody& softBody)
+void Renderer::resetCollisions(VkCommandBuffer commandBuffer)
+{
+    // Every colSize and the x group count of the batched solve start at 0, it has a row of groups per batched body
+    VkBuffer colSizeBuffer = m_colSizeBuffer[currentFrame].get();
+    vkCmdFillBuffer(commandBuffer, colSizeBuffer, 0, sizeof(uint32_t), 0);
+    vkCmdFillBuffer(commandBuffer, colSizeBuffer, sizeof(uint32_t), sizeof(uint32_t), m_batch.bodyCount);
+    vkCmdFillBuffer(commandBuffer, colSizeBuffer, 2 * sizeof(uint32_t), sizeof(uint32_t), 1);
+    vkCmdFillBuffer(commandBuffer, colSizeBuffer, 3 * sizeof(uint32_t), VK_WHOLE_SIZE, 0);
+
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1,
+        &memoryBarrier,
+        0,
+        nullptr,
+        0,
+        nullptr);
+}
+
+void Renderer::detectCollisions(VkCommandBuffer commandBuffer, uint32_t firstBody, uint32_t bodyCount, uint32_t particleGroups, bool substep)
 {
-    static uint32_t zero = 0;
-    softBody.colSizeBuffer[currentFrame].map();
-    softBody.colSizeBuffer[currentFrame].writeTo(&zero, sizeof(uint32_t));
-    softBody.colSizeBuffer[currentFrame].unmap();
+    if (m_colliderBVH.getTriangleCount() == 0 || bodyCount == 0)
+        return;
 
-    m_colPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { m_colDescriptorSet.get(currentFrame), softBody.colDescriptorSet.get(currentFrame) });
+    // Workgroups whose swept bounds touch no bvh leaf return before the narrowphase
+    BodyPushConstants pushConstants{};
+    pushConstants.firstBody = firstBody;
+    pushConstants.substepDetection = substep;
+
+    m_colPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { m_colDescriptorSet.get(currentFrame) });
+    m_colPipelineLayout.pushConstants(commandBuffer, sizeof(BodyPushConstants), &pushConstants);
 
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_staticColDetectionPipeline.get());
-    vkCmdDispatch(commandBuffer, (m_colUBO[currentFrame].get().triCount + 31) / 32, 1, 1);
+    vkCmdDispatch(commandBuffer, particleGroups, bodyCount, 1);
 }
 
-void Renderer::computePhysics(VkCommandBuffer commandBuffer, SoftBody& softBody)
+void Renderer::saveCollisionSizes(VkCommandBuffer commandBuffer)
 {
     VkMemoryBarrier memoryBarrier = {};
     memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
     memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    m_pbdPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { m_pbdDescriptorSet.get(currentFrame), softBody.pbdDescriptorSet.get(0) });
+    memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        1,
+        &memoryBarrier,
+        0,
+        nullptr,
+        0,
+        nullptr);
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_presolvePipeline.get());
-    vkCmdDispatch(commandBuffer, (softBody.tetMesh.getParticleCount() + 31) / 32, 1, 1);
+    // Every slot keeps its saved size in the word after its collision size, the group count of the solve is saved after its dispatch
+    BatchedBody* bodies = (BatchedBody*)m_bodyTableBuffer[currentFrame].getMapped();
+    std::vector<VkBufferCopy> regions(m_batch.bodyCount + 1);
+    regions[0].srcOffset = 0;
+    regions[0].dstOffset = 3 * sizeof(uint32_t);
+    regions[0].size = sizeof(uint32_t);
+    for (uint32_t i = 0; i < m_batch.bodyCount; i++)
+    {
+        regions[i + 1].srcOffset = COL_SIZE_STRIDE * (bodies[i].slot + 1);
+        regions[i + 1].dstOffset = regions[i + 1].srcOffset + sizeof(uint32_t);
+        regions[i + 1].size = sizeof(uint32_t);
+    }
+    vkCmdCopyBuffer(commandBuffer, m_colSizeBuffer[currentFrame].get(), m_colSizeBuffer[currentFrame].get(), (uint32_t)regions.size(), regions.data());
 
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
     vkCmdPipelineBarrier(commandBuffer,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
         0,
         1,
@@ -125,22 +188,67 @@ void Renderer::computePhysics(VkCommandBuffer commandBuffer, SoftBody& softBody)
         nullptr,
         0,
         nullptr);
+}
 
-    m_colPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { m_colDescriptorSet.get(currentFrame), softBody.colDescriptorSet.get(currentFrame) });
+void Renderer::updatePrimitiveColliders()
+{
+    ColliderPrimitive* primitives = (ColliderPrimitive*)m_primitiveBuffer[currentFrame].getMapped();
+    uint32_t count = std::min((uint32_t)m_primitives.size(), (uint32_t)MAX_COLLIDER_PRIMITIVE_COUNT);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        glm::quat rotation(glm::radians(m_primitives[i].rotation));
+        primitives[i].center = m_primitives[i].center;
+        primitives[i].type = (uint32_t)m_primitives[i].type;
+        primitives[i].extents = m_primitives[i].extents;
+        primitives[i].rotation = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+    }
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_colConstraintPipeline.get());
-    vkCmdDispatch(commandBuffer, (MAX_COLLISION_CONSTRAINT_COUNT + 31) / 32, 1, 1);
+    m_colUBO[currentFrame].get().primitiveCount = count;
+    m_colUBO[currentFrame].update();
+}
 
-    m_pbdPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { m_pbdDescriptorSet.get(currentFrame), softBody.pbdDescriptorSet.get(0) });
-    
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_stretchConstraintPipeline.get());
-    vkCmdDispatch(commandBuffer, (softBody.tetMesh.getEdgeCount() + 31) / 32, 1, 1);
+void Renderer::detectBodyCollisions(VkCommandBuffer commandBuffer)
+{
+    // Every active body has an entry in the body table, the batched ones first and the fused ones after them
+    BatchedBody* bodies = (BatchedBody*)m_bodyTableBuffer[currentFrame].getMapped();
+    uint32_t bodyCount = m_batch.bodyCount + m_batch.fusedCount;
+    uint32_t particleCount = 0;
+    for (uint32_t i = 0; i < bodyCount; i++)
+        particleCount += bodies[i].range.particleCount;
+    if (!m_bodyCollisions || bodyCount < 2 || particleCount > m_gridCapacity)
+        return;
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_volumeConstraintPipeline.get());
-    vkCmdDispatch(commandBuffer, (softBody.tetMesh.getTetCount() + 31) / 32, 1, 1);
+    ColDetectionUBO& ubo = m_colUBO[currentFrame].get();
+    ubo.particleCount = particleCount;
+    ubo.tableSize = 2 * particleCount;
+    ubo.contactDistance = m_contactDistance;
+    ubo.bodyCount = bodyCount;
+    m_colUBO[currentFrame].update();
+
+    // Gather the predicted positions of every body from the pool into the grid in table order, bodies keep their particle order
+    std::vector<VkBufferCopy> regions(bodyCount);
+    VkDeviceSize offset = 0;
+    for (uint32_t i = 0; i < bodyCount; i++)
+    {
+        regions[i].srcOffset = sizeof(PbdPositions) * bodies[i].range.particleOffset;
+        regions[i].dstOffset = offset;
+        regions[i].size = sizeof(PbdPositions) * bodies[i].range.particleCount;
+        offset += regions[i].size;
+    }
+    vkCmdCopyBuffer(commandBuffer, m_pool.getPositionBuffer().get(), m_gridPositionsBuffer.get(), bodyCount, regions.data());
+    vkCmdFillBuffer(commandBuffer, m_gridCellStartBuffer.get(), 0, sizeof(uint32_t) * (ubo.tableSize + 1), 0);
 
+    // Empty bounds, the lower bounds of every body are reduced with atomic min and the upper bounds after them with atomic max
+    VkDeviceSize boundsSize = sizeof(glm::uvec4) * bodyCount;
+    vkCmdFillBuffer(commandBuffer, m_bodyBoundsBuffer.get(), 0, boundsSize, UINT32_MAX);
+    vkCmdFillBuffer(commandBuffer, m_bodyBoundsBuffer.get(), boundsSize, boundsSize, 0);
+
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
     vkCmdPipelineBarrier(commandBuffer,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
         0,
         1,
@@ -149,14 +257,36 @@ void Renderer::computePhysics(VkCommandBuffer commandBuffer, SoftBody& softBody)
         nullptr,
         0,
         nullptr);
-    
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_postsolvePipeline.get());
-    vkCmdDispatch(commandBuffer, (softBody.tetMesh.getParticleCount() + 31) / 32, 1, 1);
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    auto computeBarrier = [&]()
+    {
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1,
+            &memoryBarrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+    };
 
+    // Broadphase: reduce every body to its bounds with a row per table entry, then sweep and prune them into pairs and indirect dispatches.
+    // The bounds keep where each body starts in the grid, so the narrowphase finds the particles of both bodies of a pair
+    m_colPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { m_colDescriptorSet.get(currentFrame) });
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_particleBoundsPipeline.get());
+    vkCmdDispatch(commandBuffer, std::max(m_batch.particleGroups, m_batch.fusedParticleGroups), bodyCount, 1);
+    computeBarrier();
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_bodyBroadphasePipeline.get());
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
     vkCmdPipelineBarrier(commandBuffer,
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
         0,
         1,
         &memoryBarrier,
@@ -164,23 +294,331 @@ void Renderer::computePhysics(VkCommandBuffer commandBuffer, SoftBody& softBody)
         nullptr,
         0,
         nullptr);
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    // Counting sort of the particles by cell: count, scan the counts, scatter. Skipped when no bounds overlap
+    VkBuffer dispatchBuffer = m_bodyDispatchBuffer.get();
+    VkDeviceSize dispatchStride = sizeof(glm::uvec4);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_particleHashPipeline.get());
+    vkCmdDispatchIndirect(commandBuffer, dispatchBuffer, 0);
+    computeBarrier();
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_prefixScanPipeline.get());
+    vkCmdDispatchIndirect(commandBuffer, dispatchBuffer, dispatchStride);
+    computeBarrier();
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_prefixScanBlocksPipeline.get());
+    vkCmdDispatchIndirect(commandBuffer, dispatchBuffer, 2 * dispatchStride);
+    computeBarrier();
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_prefixScanAddPipeline.get());
+    vkCmdDispatchIndirect(commandBuffer, dispatchBuffer, dispatchStride);
+    computeBarrier();
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_particleScatterPipeline.get());
+    vkCmdDispatchIndirect(commandBuffer, dispatchBuffer, 0);
+    computeBarrier();
+
+    // Two rows per overlapping pair, each tests the particles of one body against the other body only.
+    // Contacts are appended to the collision constraints of the body the particle belongs to
+    m_colPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { m_colDescriptorSet.get(currentFrame) });
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_particleColDetectionPipeline.get());
+    vkCmdDispatchIndirect(commandBuffer, dispatchBuffer, PAIR_DISPATCH_OFFSET * dispatchStride);
 }
 
-void Renderer::deformMesh(VkCommandBuffer commandBuffer, SoftBody& softBody)
+void Renderer::reserveParticleGrid(uint32_t particleCount)
+{
+    if (particleCount <= m_gridCapacity)
+        return;
+
+    // Only happens while bodies are loaded, the grid may still be in use by the previous frame
+    vkQueueWaitIdle(m_device.getComputeQueue());
+    if (m_gridCapacity > 0)
+    {
+        m_gridBlockSumsBuffer.cleanup();
+        m_gridCellEntriesBuffer.cleanup();
+        m_gridCellStartBuffer.cleanup();
+        m_gridCellsBuffer.cleanup();
+        m_gridPositionsBuffer.cleanup();
+    }
+
+    m_gridCapacity = std::max(particleCount, 2 * m_gridCapacity);
+    uint32_t tableSize = 2 * m_gridCapacity;
+    uint32_t scanBlocks = (tableSize + GRID_SCAN_BLOCK_SIZE) / GRID_SCAN_BLOCK_SIZE;
+
+    m_gridPositionsBuffer.init(m_device,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        sizeof(PbdPositions) * m_gridCapacity
+    );
+    m_gridCellsBuffer.init(m_device,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        sizeof(uint32_t) * m_gridCapacity
+    );
+    m_gridCellStartBuffer.init(m_device,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        sizeof(uint32_t) * (tableSize + 1)
+    );
+    m_gridCellEntriesBuffer.init(m_device,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        sizeof(uint32_t) * m_gridCapacity
+    );
+    m_gridBlockSumsBuffer.init(m_device,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        sizeof(uint32_t) * scanBlocks
+    );
+
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        m_colDescriptorSet.writeBuffer(i, 3, m_gridPositionsBuffer);
+        m_colDescriptorSet.writeBuffer(i, 4, m_gridCellsBuffer);
+        m_colDescriptorSet.writeBuffer(i, 5, m_gridCellStartBuffer);
+        m_colDescriptorSet.writeBuffer(i, 6, m_gridCellEntriesBuffer);
+        m_colDescriptorSet.writeBuffer(i, 7, m_gridBlockSumsBuffer);
+    }
+}
+
+void Renderer::solveColored(VkCommandBuffer commandBuffer, Pipeline& pipeline, const std::array<uint32_t, ResourceManager::MAX_CONSTRAINT_COLORS + 1>& colorGroups,
+    uint32_t bodyCount)
 {
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.get());
+
+    // The last index is the uncoloured remainder. Every colour waits for the previous one, which may belong to the previous constraint type
+    BodyPushConstants pushConstants{};
+    for (uint32_t i = 0; i < (uint32_t)colorGroups.size(); i++)
+    {
+        if (!colorGroups[i])
+            continue;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1,
+            &memoryBarrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+
+        pushConstants.color = i;
+        m_colPipelineLayout.pushConstants(commandBuffer, sizeof(BodyPushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, colorGroups[i], bodyCount, 1);
+    }
+}
+
+void Renderer::updateSubSteps()
+{
+    const BodyResidual* residuals = (const BodyResidual*)m_bodyResidualBuffer[currentFrame].getMapped();
+    bool pending = m_residualPending[currentFrame];
+    m_residualPending[currentFrame] = false;
+    float stepTime = 1.0f / (float)m_fixedTimeStep;
+
+    for (uint32_t i = 0; i < MAX_SOFT_BODY_COUNT; i++)
+    {
+        SoftBody& softBody = m_softBodies[i];
+        if (!softBody.active)
+            break;
+
+        if (!m_adaptiveSubsteps)
+        {
+            softBody.subStepCount = (uint32_t)m_subSteps;
+            continue;
+        }
+
+        // New bodies start with the whole budget
+        int count = (int)softBody.subStepCount;
+        if (count == 0)
+            count = m_maxSubSteps;
+        else if (pending)
+        {
+            // Grow quickly while constraints are violated, shrink one substep at a time once well below the target
+            if (residuals[i].residual > m_targetResidual)
+                count += std::max(count / 2, 1);
+            else if (residuals[i].residual < 0.5f * m_targetResidual)
+                count--;
+
+            // No particle should move further than half the contact distance in one substep
+            count = std::max(count, (int)std::ceil(residuals[i].maxSpeed * stepTime / (0.5f * m_contactDistance)));
+        }
+        softBody.subStepCount = (uint32_t)std::clamp(count, m_minSubSteps, m_maxSubSteps);
+    }
+
+    if (pending)
+        memset(m_bodyResidualBuffer[currentFrame].getMapped(), 0, sizeof(BodyResidual) * MAX_SOFT_BODY_COUNT);
+}
+
+// Spreads the colour offsets of a body over every colour index, the colours it does not have are empty.
+// Grows the groups of each colour to cover the range of the body
+static void writeColorOffsets(const std::vector<uint32_t>& offsets, uint32_t* colorOffsets,
+    std::array<uint32_t, ResourceManager::MAX_CONSTRAINT_COLORS + 1>& colorGroups)
+{
+    const uint32_t maxColors = ResourceManager::MAX_CONSTRAINT_COLORS;
+    uint32_t colorCount = (uint32_t)offsets.size() - 2;
+    for (uint32_t i = 0; i <= maxColors; i++)
+        colorOffsets[i] = offsets[std::min(i, colorCount)];
+    colorOffsets[maxColors + 1] = offsets[colorCount + 1];
+
+    for (uint32_t i = 0; i <= maxColors; i++)
+        colorGroups[i] = std::max(colorGroups[i], (colorOffsets[i + 1] - colorOffsets[i] + 31) / 32);
+}
+
+void Renderer::updateBodyTable()
+{
+    // Bodies solved stage by stage come first, the fused bodies follow
+    BatchedBody* bodies = (BatchedBody*)m_bodyTableBuffer[currentFrame].getMapped();
+    uint32_t maxParticles = 0;
+    uint32_t maxEdges = 0;
+    uint32_t maxTets = 0;
+
+    m_batch = BatchedDispatch();
+    for (int fused = 0; fused < 2; fused++)
+    {
+        for (uint32_t i = 0; i < MAX_SOFT_BODY_COUNT; i++)
+        {
+            SoftBody& softBody = m_softBodies[i];
+            if (!softBody.active)
+                break;
+            if (useFusedSubsteps(softBody) != (fused == 1))
+                continue;
+
+            BatchedBody& body = bodies[m_batch.bodyCount + m_batch.fusedCount];
+            body.range = softBody.tetMesh.getRange();
+            body.slot = i;
+            body.subStepCount = softBody.subStepCount;
+            m_batch.residualGroups = std::max(m_batch.residualGroups,
+                (std::max({ body.range.particleCount, body.range.edgeCount, body.range.tetCount }) + 31) / 32);
+
+            if (fused)
+            {
+                m_batch.fusedCount++;
+                continue;
+            }
+            m_batch.bodyCount++;
+            m_batch.maxSubSteps = std::max(m_batch.maxSubSteps, body.subStepCount);
+            maxParticles = std::max(maxParticles, body.range.particleCount);
+            maxEdges = std::max(maxEdges, body.range.edgeCount);
+            maxTets = std::max(maxTets, body.range.tetCount);
+        }
+    }
+
+    // Most substeps first, so that every pass covers a prefix of the batched bodies
+    std::stable_sort(bodies, bodies + m_batch.bodyCount, [](const BatchedBody& a, const BatchedBody& b) { return a.subStepCount > b.subStepCount; });
+
+    // The colour ranges follow the sorted table, a coloured pass solves one colour of every body
+    BodyColors* colors = (BodyColors*)m_bodyColorBuffer[currentFrame].getMapped();
+    for (uint32_t i = 0; i < m_batch.bodyCount; i++)
+    {
+        SoftBody& softBody = m_softBodies[bodies[i].slot];
+        writeColorOffsets(softBody.edgeColorOffsets, colors[i].edgeOffsets, m_batch.edgeColorGroups);
+        writeColorOffsets(softBody.tetColorOffsets, colors[i].tetOffsets, m_batch.tetColorGroups);
+    }
+    for (uint32_t i = 0; i <= ResourceManager::MAX_CONSTRAINT_COLORS; i++)
+        m_batch.coloredDispatches += (m_batch.edgeColorGroups[i] != 0) + (m_batch.tetColorGroups[i] != 0);
+
+    m_batch.particleGroups = (maxParticles + 31) / 32;
+    m_batch.fusedParticleGroups = m_batch.fusedCount ? m_fusedParticleCount / 32 : 0;
+    m_batch.edgeGroups = (maxEdges + 31) / 32;
+    m_batch.tetGroups = (maxTets + 31) / 32;
+}
+
+void Renderer::computePhysics(VkCommandBuffer commandBuffer, uint32_t subStep)
+{
+    // The batched bodies are sorted by substep count, the ones still stepping are a prefix of the table
+    BatchedBody* bodies = (BatchedBody*)m_bodyTableBuffer[currentFrame].getMapped();
+    uint32_t bodyCount = 0;
+    while (bodyCount < m_batch.bodyCount && bodies[bodyCount].subStepCount > subStep)
+        bodyCount++;
+    if (bodyCount == 0)
+        return;
+
     VkMemoryBarrier memoryBarrier = {};
     memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
     memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
     memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-    m_deformPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { softBody.deformDescriptorSet.get(0) });
+    // Contacts of this substep only, so fast bodies are caught within a substep and fewer constraints pile up per body
+    if (m_substepDetection && m_colliderBVH.getTriangleCount() > 0)
+    {
+        detectCollisions(commandBuffer, 0, bodyCount, m_batch.particleGroups, true);
+
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            0,
+            1,
+            &memoryBarrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    }
+
+    // Every stage covers all stepping bodies of the batch, one row of workgroups per body
+    BodyPushConstants pushConstants{};
+    pushConstants.subStep = subStep;
+    m_colPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { m_colDescriptorSet.get(currentFrame) });
+    m_colPipelineLayout.pushConstants(commandBuffer, sizeof(BodyPushConstants), &pushConstants);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_presolvePipeline.get());
+    vkCmdDispatch(commandBuffer, m_batch.particleGroups, bodyCount, 1);
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1,
+        &memoryBarrier,
+        0,
+        nullptr,
+        0,
+        nullptr);
+
+    // Detection wrote the group count of the largest body in front of the collision sizes, nothing is dispatched without contacts.
+    // It always has a row per batched body, the rows of bodies past their last substep return
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_colConstraintPipeline.get());
+    vkCmdDispatchIndirect(commandBuffer, m_colSizeBuffer[currentFrame].get(), 0);
+
+    if (m_sdfLoaded)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_sdfCollisionPipeline.get());
+        vkCmdDispatch(commandBuffer, m_batch.particleGroups, bodyCount, 1);
+    }
 
-    if (softBody.useTetDeformation)
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_tetDeformPipeline.get());
+    if (!m_primitives.empty())
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_primitiveCollisionPipeline.get());
+        vkCmdDispatch(commandBuffer, m_batch.particleGroups, bodyCount, 1);
+    }
+
+    // Collisions still accumulate into delta, the coloured constraints move predict directly.
+    // A coloured pass solves the same colour of every stepping body, so the dispatch count is that of the body with the most colours
+    writeSolveTimestamp(commandBuffer);
+    if (m_coloredSolve)
+    {
+        solveColored(commandBuffer, m_stretchConstraintColoredPipeline, m_batch.edgeColorGroups, bodyCount);
+        solveColored(commandBuffer, m_volumeConstraintColoredPipeline, m_batch.tetColorGroups, bodyCount);
+    }
     else
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_deformPipeline.get());
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_stretchConstraintPipeline.get());
+        vkCmdDispatch(commandBuffer, m_batch.edgeGroups, bodyCount, 1);
 
-    vkCmdDispatch(commandBuffer, (softBody.mesh.getVertexCount() + 31) / 32, 1, 1);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_volumeConstraintPipeline.get());
+        vkCmdDispatch(commandBuffer, m_batch.tetGroups, bodyCount, 1);
+    }
 
     vkCmdPipelineBarrier(commandBuffer,
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
@@ -192,9 +630,10 @@ void Renderer::deformMesh(VkCommandBuffer commandBuffer, SoftBody& softBody)
         nullptr,
         0,
         nullptr);
+    writeSolveTimestamp(commandBuffer);
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_recalcNormalsPipeline.get());
-    vkCmdDispatch(commandBuffer, (softBody.mesh.getIndexCount() / 3 + 31) / 32, 1, 1);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_postsolvePipeline.get());
+    vkCmdDispatch(commandBuffer, m_batch.particleGroups, bodyCount, 1);
 
     vkCmdPipelineBarrier(commandBuffer,
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
@@ -206,9 +645,33 @@ void Renderer::deformMesh(VkCommandBuffer commandBuffer, SoftBody& softBody)
         nullptr,
         0,
         nullptr);
+}
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_normalizeNormalsPipeline.get());
-    vkCmdDispatch(commandBuffer, (softBody.mesh.getVertexCount() + 31) / 32, 1, 1);
+bool Renderer::useFusedSubsteps(SoftBody& softBody)
+{
+    // The coloured solve has no fused variant
+    return m_fusedSubsteps && m_fusedSubstepsSupported && !m_coloredSolve && softBody.tetMesh.getParticleCount() <= m_fusedParticleCount;
+}
+
+void Renderer::computePhysicsFused(VkCommandBuffer commandBuffer)
+{
+    if (m_batch.fusedCount == 0)
+        return;
+
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    // One workgroup per fused body
+    BodyPushConstants pushConstants{};
+    pushConstants.firstBody = m_batch.bodyCount;
+
+    m_colPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { m_colDescriptorSet.get(currentFrame) });
+    m_colPipelineLayout.pushConstants(commandBuffer, sizeof(BodyPushConstants), &pushConstants);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_fusedSubstepPipeline.get());
+    vkCmdDispatch(commandBuffer, 1, m_batch.fusedCount, 1);
 
     vkCmdPipelineBarrier(commandBuffer,
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
@@ -222,6 +685,175 @@ void Renderer::deformMesh(VkCommandBuffer commandBuffer, SoftBody& softBody)
         nullptr);
 }
 
+void Renderer::reduceBodyResiduals(VkCommandBuffer commandBuffer)
+{
+    bool reduce = m_adaptiveSubsteps && m_batch.bodyCount + m_batch.fusedCount != 0;
+    if (reduce)
+    {
+        m_colPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { m_colDescriptorSet.get(currentFrame) });
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_bodyResidualPipeline.get());
+        vkCmdDispatch(commandBuffer, m_batch.residualGroups, m_batch.bodyCount + m_batch.fusedCount, 1);
+    }
+
+    // The residuals and the dropped contacts are read on the host after the fence of this frame, no stall
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        1,
+        &memoryBarrier,
+        0,
+        nullptr,
+        0,
+        nullptr);
+    m_residualPending[currentFrame] = reduce;
+    m_overflowPending[currentFrame] = true;
+}
+
+void Renderer::writeSolveTimestamp(VkCommandBuffer commandBuffer)
+{
+    if (m_solveQueryPools.empty() || m_solveQueryCount[currentFrame] == 2 * MAX_TIMED_SUBSTEP_COUNT)
+        return;
+
+    // Written once the earlier dispatches have left the compute stage, the start excludes the collision passes
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, m_solveQueryPools[currentFrame], m_solveQueryCount[currentFrame]++);
+    m_solveQueryColored[currentFrame] = m_coloredSolve;
+}
+
+void Renderer::updateSolveTimes(VkCommandBuffer commandBuffer)
+{
+    if (m_solveQueryPools.empty())
+        return;
+
+    uint32_t queryCount = m_solveQueryCount[currentFrame];
+    if (queryCount > 0)
+    {
+        uint64_t timestamps[2 * MAX_TIMED_SUBSTEP_COUNT];
+        vkGetQueryPoolResults(m_device.getLogical(), m_solveQueryPools[currentFrame], 0, queryCount,
+            sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+        uint64_t ticks = 0;
+        for (uint32_t i = 0; i + 1 < queryCount; i += 2)
+            ticks += timestamps[i + 1] - timestamps[i];
+        m_solveTime = (float)ticks * m_device.getTimestampPeriod() * 1e-6f;
+
+        // Frames recorded while the bodies were reloaded are left out
+        std::vector<float>& times = m_solveTimes[m_solveQueryColored[currentFrame]];
+        if (m_measureSolve && m_pendingSoftBodies.empty() && times.size() < (size_t)m_frameCount)
+        {
+            times.push_back(m_solveTime);
+            if (m_solveTimes[0].size() == (size_t)m_frameCount && !m_coloredSolve)
+                m_coloredSolve = true;
+            else if (m_solveTimes[1].size() == (size_t)m_frameCount)
+            {
+                std::string path(
+                    "../measurements/solve/" +
+                    std::string(m_modelName) + "_" +
+                    std::to_string(m_modelResolution) + "_" +
+                    std::to_string(m_modelCount) + "_" +
+                    std::to_string(m_frameCount) + ".txt"
+                );
+                std::ofstream out(path);
+
+                // Atomic and coloured solve time of each frame in milliseconds
+                for (int i = 0; i < m_frameCount; i++)
+                    out << m_solveTimes[0][i] << " " << m_solveTimes[1][i] << "\n";
+
+                out.close();
+                LOG_WRITE("Successfully performed solve measurements");
+                m_measureSolve = false;
+                m_coloredSolve = false;
+                m_fusedSubsteps = m_measureFusedSubsteps;
+            }
+        }
+    }
+
+    vkCmdResetQueryPool(commandBuffer, m_solveQueryPools[currentFrame], 0, 2 * MAX_TIMED_SUBSTEP_COUNT);
+    m_solveQueryCount[currentFrame] = 0;
+}
+
+void Renderer::startSolveMeasurement()
+{
+    m_solveTimes[0].clear();
+    m_solveTimes[1].clear();
+    m_measureSolve = true;
+    m_measureFusedSubsteps = m_fusedSubsteps;
+    m_fusedSubsteps = false;
+    m_coloredSolve = false;
+
+    for (int i = 0; i < MAX_SOFT_BODY_COUNT; i++)
+    {
+        if (!m_softBodies[i].active)
+            break;
+        m_removeBodies.push_back(&m_softBodies[i]);
+    }
+
+    m_loadSoftBodies = 1;
+}
+
+void Renderer::readCollisionOverflow()
+{
+    if (!m_overflowPending[currentFrame])
+        return;
+    m_overflowPending[currentFrame] = false;
+
+    CollisionOverflow* overflow = (CollisionOverflow*)m_colOverflowBuffer[currentFrame].getMapped();
+    m_droppedContacts = *overflow;
+    *overflow = CollisionOverflow();
+}
+
+void Renderer::deformMeshes(VkCommandBuffer commandBuffer)
+{
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    // The render meshes are separate buffers per body, so every body keeps its own dispatch.
+    // The bodies do not share vertices, a stage of every body only waits for the previous stage
+    for (int stage = 0; stage < 3; stage++)
+    {
+        for (auto& softBody : m_softBodies)
+        {
+            if (!softBody.active)
+                break;
+
+            m_deformPipelineLayout.bindDescriptors(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, { softBody.deformDescriptorSet.get(0) });
+            if (stage == 0)
+            {
+                Pipeline& pipeline = softBody.useTetDeformation ? m_tetDeformPipeline : m_deformPipeline;
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.get());
+                vkCmdDispatch(commandBuffer, (softBody.mesh.getVertexCount() + 31) / 32, 1, 1);
+            }
+            else if (stage == 1)
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_recalcNormalsPipeline.get());
+                vkCmdDispatch(commandBuffer, (softBody.mesh.getIndexCount() / 3 + 31) / 32, 1, 1);
+            }
+            else
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_normalizeNormalsPipeline.get());
+                vkCmdDispatch(commandBuffer, (softBody.mesh.getVertexCount() + 31) / 32, 1, 1);
+            }
+        }
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1,
+            &memoryBarrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+    }
+}
+
 void Renderer::createSyncObjects()
 {
     m_imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
@@ -248,11 +880,26 @@ void Renderer::createSyncObjects()
             vkCreateFence(m_device.getLogical(), &fenceInfo, nullptr, &m_computeInFlightFences[i]) != VK_SUCCESS)
             LOG_ERROR("Failed to create compute synchronization objects for a frame!");
     }
+
+    if (!m_device.supportsTimestamps())
+        return;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2 * MAX_TIMED_SUBSTEP_COUNT;
+
+    m_solveQueryPools.resize(MAX_FRAMES_IN_FLIGHT);
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        if (vkCreateQueryPool(m_device.getLogical(), &queryPoolInfo, nullptr, &m_solveQueryPools[i]) != VK_SUCCESS)
+            LOG_ERROR("Failed to create a timestamp query pool!");
+    }
 }
 
 void Renderer::createResources()
 {
-    m_softBodies[0] = createSoftBody(m_modelName, m_offset);
+    loadSoftBody(m_modelName, m_offset);
 
     m_texture = m_resources.loadTexture("assets/textures/texture.jpg");
     m_sampler.init(m_device);
@@ -289,159 +936,421 @@ void Renderer::createResources()
         0, 3, 1,
     };
 
+    UploadBatch upload;
+    upload.init(m_device);
+
     MeshData floorMeshData = { floorVertices, floorIndices };
-    m_floorMesh.init(m_device, m_commandPool, &floorMeshData);
+    m_floorMesh.init(m_device, upload, &floorMeshData);
     m_floorTexture = m_resources.loadTexture("assets/textures/check.jpg");
 
     m_floorMaterial.tint = glm::vec3(1.0f);
     m_floorMaterial.roughness = 1.0f;
     m_floorMaterial.metallic = 0.0f;
 
-    // Collision data
-    VkDeviceSize bufferSize = sizeof(avec3) * floorVertices.positions.size();
-    Buffer stagingBuffer;
-    stagingBuffer.init(m_device,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        bufferSize,
-        (void*)floorVertices.positions.data()
+    // Body broadphase, sized for every pair of MAX_SOFT_BODY_COUNT bodies. The pair count comes first, padded to the alignment of the pairs
+    m_bodyBoundsBuffer.init(m_device,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        2 * sizeof(glm::uvec4) * MAX_SOFT_BODY_COUNT
     );
-
-    m_colPositionsBuffer.init(m_device,
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-        bufferSize
+    m_bodyPairsBuffer.init(m_device,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        sizeof(glm::uvec2) * (1 + MAX_SOFT_BODY_COUNT * (MAX_SOFT_BODY_COUNT - 1) / 2)
     );
+    m_bodyDispatchBuffer.init(m_device,
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        sizeof(glm::uvec4) * (PAIR_DISPATCH_OFFSET + 1)
+    );
+
+    m_primitiveBuffer.resize(MAX_FRAMES_IN_FLIGHT);
+    m_bodyTableBuffer.resize(MAX_FRAMES_IN_FLIGHT);
+    m_bodyColorBuffer.resize(MAX_FRAMES_IN_FLIGHT);
+    m_colSizeBuffer.resize(MAX_FRAMES_IN_FLIGHT);
+    m_colConstraintBuffer.resize(MAX_FRAMES_IN_FLIGHT);
+    m_colOverflowBuffer.resize(MAX_FRAMES_IN_FLIGHT);
+    m_bodyResidualBuffer.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        m_primitiveBuffer[i].init(m_device,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            sizeof(ColliderPrimitive) * MAX_COLLIDER_PRIMITIVE_COUNT
+        );
+        m_primitiveBuffer[i].map();
+
+        m_bodyTableBuffer[i].init(m_device,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            sizeof(BatchedBody) * MAX_SOFT_BODY_COUNT
+        );
+        m_bodyTableBuffer[i].map();
+
+        m_bodyColorBuffer[i].init(m_device,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            sizeof(BodyColors) * MAX_SOFT_BODY_COUNT
+        );
+        m_bodyColorBuffer[i].map();
 
-    m_commandPool.copyBuffer(stagingBuffer, m_colPositionsBuffer, bufferSize);
-    stagingBuffer.cleanup();
+        // The solve dispatch takes the place of slot -1
+        m_colSizeBuffer[i].init(m_device,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            COL_SIZE_STRIDE * (MAX_SOFT_BODY_COUNT + 1)
+        );
+        m_colConstraintBuffer[i].init(m_device,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            sizeof(ColConstraint) * (MAX_COLLISION_CONSTRAINT_COUNT + MAX_BODY_CONTACT_COUNT) * MAX_SOFT_BODY_COUNT
+        );
+        m_colOverflowBuffer[i].init(m_device,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            sizeof(CollisionOverflow)
+        );
+        m_colOverflowBuffer[i].map();
+        *(CollisionOverflow*)m_colOverflowBuffer[i].getMapped() = CollisionOverflow();
+
+        m_bodyResidualBuffer[i].init(m_device,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            sizeof(BodyResidual) * MAX_SOFT_BODY_COUNT
+        );
+        m_bodyResidualBuffer[i].map();
+        memset(m_bodyResidualBuffer[i].getMapped(), 0, sizeof(BodyResidual) * MAX_SOFT_BODY_COUNT);
+    }
+
+    upload.submit(m_commandPool);
+    upload.cleanup();
+
+    // The descriptors need a field before the first one is ready
+    loadStaticCollider(m_colliderName);
+    uploadSdfCollider(SignedDistanceFieldData(), MeshData());
+    if (m_sdfName[0] != '\0')
+        loadSdfCollider(m_sdfName, m_sdfResolution);
+}
+
+void Renderer::loadStaticCollider(const std::string& name)
+{
+    MeshData mesh;
+    if (!name.empty())
+    {
+        mesh = m_resources.loadMeshOBJ("assets/models/" + name + ".obj");
+        if (!mesh.vertices.positions.size())
+            return;
+    }
+
+    // The previous collider may still be in use by frames in flight
+    if (m_colliderBuffersCreated)
+    {
+        vkQueueWaitIdle(m_device.getComputeQueue());
+        vkQueueWaitIdle(m_device.getGraphicsQueue());
+        m_colTrianglesBuffer.cleanup();
+        m_colNodesBuffer.cleanup();
+    }
+    if (m_renderCollider)
+    {
+        m_colliderMesh.cleanup();
+        m_renderCollider = false;
+    }
+
+    m_colliderBVH.init(mesh.vertices.positions, mesh.indices);
+    m_colliderMeshData = std::move(mesh);
+
+    UploadBatch upload;
+    upload.init(m_device);
+
+    if (m_colliderMeshData.indices.size() > 0)
+    {
+        m_colliderMesh.init(m_device, upload, &m_colliderMeshData);
+        m_renderCollider = true;
+    }
 
-    bufferSize = sizeof(uint32_t) * floorIndices.size();
-    stagingBuffer.init(m_device,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        bufferSize,
-        (void*)floorIndices.data()
+    // Without a collider mesh the buffers hold a single unused element, the descriptors have to stay valid
+    VkDeviceSize bufferSize = sizeof(TriangleBVH::Node) * m_colliderBVH.getNodeCount();
+    m_colNodesBuffer.init(m_device,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        std::max(bufferSize, (VkDeviceSize)sizeof(TriangleBVH::Node))
     );
+    if (bufferSize > 0)
+        upload.add(m_colNodesBuffer, m_colliderBVH.getNodes().data(), bufferSize);
 
-    m_colIndicesBuffer.init(m_device,
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    bufferSize = sizeof(TriangleBVH::Triangle) * m_colliderBVH.getTriangleCount();
+    m_colTrianglesBuffer.init(m_device,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        bufferSize
+        std::max(bufferSize, (VkDeviceSize)sizeof(TriangleBVH::Triangle))
     );
+    if (bufferSize > 0)
+        upload.add(m_colTrianglesBuffer, m_colliderBVH.getTriangles().data(), bufferSize);
+    m_colliderBuffersCreated = true;
 
-    m_commandPool.copyBuffer(stagingBuffer, m_colIndicesBuffer, bufferSize);
-    stagingBuffer.cleanup();
+    upload.submit(m_commandPool);
+    upload.cleanup();
 
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
-        m_colUBO[i].get().triCount = (uint32_t)floorIndices.size() / 3;
+        m_colUBO[i].get().triCount = m_colliderBVH.getTriangleCount();
         m_colUBO[i].update();
+        m_colDescriptorSet.writeBuffer(i, 1, m_colNodesBuffer);
+        m_colDescriptorSet.writeBuffer(i, 2, m_colTrianglesBuffer);
     }
 }
 
-SoftBody Renderer::createSoftBody(const std::string& name, glm::vec3 offset, int resolution)
+void Renderer::loadSdfCollider(const std::string& name, uint32_t resolution)
 {
-    SoftBody softBody;
-    SoftBodyData* softBodyData = m_resources.getSoftBody(name, resolution);
+    // Baking a field blocks for seconds at high resolutions, so it never happens on the render thread
+    m_pendingSdf = std::make_unique<PendingSdfCollider>();
+    PendingSdfCollider* pending = m_pendingSdf.get();
+    pending->name = name;
+    pending->baked = m_threadPool.async([this, pending, name, resolution]()
+    {
+        if (name.empty())
+            return true;
+        if (!m_resources.loadSignedDistanceField(name, resolution, pending->sdf))
+            return false;
 
-    if (!softBodyData)
-        return softBody;
+        pending->mesh = m_resources.loadMeshOBJ("assets/models/" + name + ".obj");
+        return true;
+    });
+}
 
-    softBody.mesh.init(m_device, m_commandPool, softBodyData->mesh);
-    softBody.tetMesh.init(m_device, m_commandPool, &softBodyData->tetMesh, offset);
+void Renderer::finaliseSdfCollider()
+{
+    if (!m_pendingSdf || m_pendingSdf->baked.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
 
-    softBody.pbdUBO.init(m_device, glm::uvec3(softBody.tetMesh.getParticleCount(), softBody.tetMesh.getEdgeCount(), softBody.tetMesh.getTetCount()));
-    softBody.deformUBO.init(m_device, glm::uvec2(softBody.mesh.getVertexCount(), softBody.mesh.getIndexCount()));
+    if (m_pendingSdf->baked.get())
+    {
+        uploadSdfCollider(m_pendingSdf->sdf, std::move(m_pendingSdf->mesh));
+        m_timer.reset();
+    }
+    else
+        LOG_WARNING("Failed to load signed distance field collider: " + m_pendingSdf->name);
+    m_pendingSdf.reset();
+}
 
-    softBody.graphicsDescriptorSet.init(m_device, m_tetDescriptorSetLayout, 1);
-    softBody.graphicsDescriptorSet.writeBuffer(0, 0, softBody.tetMesh.getParticleBuffer());
-    softBody.graphicsDescriptorSet.writeBuffer(0, 1, softBody.tetMesh.getTetBuffer());
+void Renderer::uploadSdfCollider(const SignedDistanceFieldData& sdf, MeshData mesh)
+{
+    // The previous field may still be in use by frames in flight
+    if (m_sdfBufferCreated)
+    {
+        vkQueueWaitIdle(m_device.getComputeQueue());
+        vkQueueWaitIdle(m_device.getGraphicsQueue());
+        m_sdfBuffer.cleanup();
+    }
+    if (m_sdfMeshData.indices.size() > 0)
+        m_sdfMesh.cleanup();
 
-    softBody.pbdDescriptorSet.init(m_device, m_pbdDescriptorSetLayout, 1);
-    softBody.pbdDescriptorSet.writeBuffer(0, 0, softBody.pbdUBO);
-    softBody.pbdDescriptorSet.writeBuffer(0, 1, softBody.tetMesh.getParticleBuffer());
-    softBody.pbdDescriptorSet.writeBuffer(0, 2, softBody.tetMesh.getPbdPosBuffer());
-    softBody.pbdDescriptorSet.writeBuffer(0, 3, softBody.tetMesh.getEdgeBuffer());
-    softBody.pbdDescriptorSet.writeBuffer(0, 4, softBody.tetMesh.getTetBuffer());
+    m_sdfMeshData = std::move(mesh);
+    m_sdfDims = sdf.dims;
+    m_sdfLoaded = sdf.distances.size() > 0;
 
-    softBody.deformDescriptorSet.init(m_device, m_deformDescriptorSetLayout, 0);
-    softBody.deformDescriptorSet.writeBuffer(0, 0, softBody.deformUBO);
-    softBody.deformDescriptorSet.writeBuffer(0, 1, softBody.mesh.getVertexBuffer(0));
-    softBody.deformDescriptorSet.writeBuffer(0, 2, softBody.mesh.getVertexBuffer(1));
-    softBody.deformDescriptorSet.writeBuffer(0, 3, softBody.mesh.getIndexBuffer());
-    softBody.deformDescriptorSet.writeBuffer(0, 4, softBody.tetMesh.getPbdPosBuffer());
-    softBody.deformDescriptorSet.writeBuffer(0, 6, softBody.tetMesh.getTetBuffer());
+    UploadBatch upload;
+    upload.init(m_device);
+
+    if (m_sdfMeshData.indices.size() > 0)
+        m_sdfMesh.init(m_device, upload, &m_sdfMeshData);
+
+    // Without a field the buffer only holds an empty header, the descriptor has to stay valid
+    SignedDistanceFieldHeader header{ glm::vec4(sdf.origin, sdf.cellSize), glm::uvec4(sdf.dims, 0) };
+    VkDeviceSize distancesSize = sizeof(float) * std::max(sdf.distances.size(), (size_t)1);
+    m_sdfBuffer.init(m_device,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        sizeof(SignedDistanceFieldHeader) + distancesSize
+    );
+    m_sdfBufferCreated = true;
+    upload.add(m_sdfBuffer, &header, sizeof(SignedDistanceFieldHeader));
+    if (m_sdfLoaded)
+        upload.add(m_sdfBuffer, sdf.distances.data(), distancesSize, sizeof(SignedDistanceFieldHeader));
+
+    upload.submit(m_commandPool);
+    upload.cleanup();
 
-    softBody.colDescriptorSet.init(m_device, m_colDescriptorSetLayout, 1, MAX_FRAMES_IN_FLIGHT);
-    softBody.colSizeBuffer.resize(MAX_FRAMES_IN_FLIGHT);
-    softBody.colConstraintBuffer.resize(MAX_FRAMES_IN_FLIGHT);
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        m_colDescriptorSet.writeBuffer(i, 11, m_sdfBuffer);
+}
+
+void Renderer::loadSoftBody(const std::string& name, glm::vec3 offset, int resolution)
+{
+    m_pendingSoftBodies.push_back(std::make_unique<PendingSoftBody>());
+    PendingSoftBody* pending = m_pendingSoftBodies.back().get();
+    pending->offset = offset;
+    pending->resolution = resolution;
+    pending->upload.init(m_device);
+
+    // Buffer creation and staging happen on the worker, the render thread only submits and finalises
+    pending->staged = m_threadPool.async([this, pending, name]()
     {
-        softBody.colSizeBuffer[i].init(m_device,
-            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            sizeof(uint32_t),
-            0
-        );
+        SoftBodyData* softBodyData = m_resources.getSoftBody(name, pending->resolution);
+        if (!softBodyData)
+            return false;
 
-        softBody.colConstraintBuffer[i].init(m_device,
-            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            sizeof(ColConstraint) * MAX_COLLISION_CONSTRAINT_COUNT,
-            0
-        );
+        createSoftBody(*pending, softBodyData);
+        return true;
+    });
+}
+
+void Renderer::finaliseSoftBodies()
+{
+    // Submit staged bodies as soon as they are ready so the copies overlap with rendering
+    int uploads = 0;
+    for (auto& pending : m_pendingSoftBodies)
+    {
+        if (uploads == MAX_SOFT_BODY_UPLOADS_PER_FRAME)
+            break;
+        if (pending->failed || pending->upload.isSubmitted() || pending->staged.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            continue;
 
-        softBody.colDescriptorSet.writeBuffer(i, 0, softBody.pbdUBO);
-        softBody.colDescriptorSet.writeBuffer(i, 1, softBody.tetMesh.getParticleBuffer());
-        softBody.colDescriptorSet.writeBuffer(i, 2, softBody.tetMesh.getPbdPosBuffer());
-        softBody.colDescriptorSet.writeBuffer(i, 3, softBody.colSizeBuffer[i]);
-        softBody.colDescriptorSet.writeBuffer(i, 4, softBody.colConstraintBuffer[i]);
+        if (pending->staged.get())
+        {
+            // Every instance of a model solves the same edges and tetrahedra, the first one stages them
+            SoftBodyData& data = *pending->data;
+            SoftBodyRange& topology = pending->softBody.sharedBuffers->topology;
+            if (pending->stagesSharedBuffers)
+                topology = TetrahedralMesh::initTopology(m_pool, pending->upload, data.getTets(), data.getTetColorOrder(), data.getTetCount(),
+                    data.getEdges(), data.getEdgeColorOrder(), data.getEdgeCount());
+            pending->softBody.tetMesh.init(m_pool, pending->upload, data.getParticles(), data.getParticleCount(), topology, pending->offset);
+            pending->upload.submit(m_commandPool);
+            uploads++;
+        }
+        else
+            pending->failed = true;
     }
 
-    Buffer stagingBuffer;
-    VkDeviceSize bufferSize = 0;
+    // The pool may have grown while staging, active bodies still describe the old buffers
+    if (m_pool.getGeneration() != m_poolGeneration)
+        writePoolDescriptors();
+
+    int slot = 0;
+    while (slot < MAX_SOFT_BODY_COUNT && m_softBodies[slot].active)
+        slot++;
 
-    // No tetrahedral deformation
-    if (resolution == 100)
+    // Shared buffers may be staged by a body further back in the queue than other instances of the model
+    for (auto& pending : m_pendingSoftBodies)
     {
-        bufferSize = sizeof(uint32_t) * softBody.mesh.getVertexCount();
-        stagingBuffer.init(m_device,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            bufferSize,
-            (void*)softBodyData->mesh->origIndices.data()
-        );
-        softBody.useTetDeformation = false;
+        if (pending->upload.isComplete() && pending->stagesSharedBuffers)
+            m_resources.setSoftBodyBuffersResident(pending->softBody.sharedBuffers);
     }
-    // Tetrahedral deformation
-    else
+
+    // Activate in load order once the copies have landed
+    while (!m_pendingSoftBodies.empty())
     {
-        bufferSize = sizeof(DeformationInfo) * (uint32_t)softBodyData->deformationInfo.size();
-        stagingBuffer.init(m_device,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            bufferSize,
-            (void*)softBodyData->deformationInfo.data()
-        );
-        softBody.useTetDeformation = true;
+        PendingSoftBody& pending = *m_pendingSoftBodies.front();
+        if (!pending.failed && (!pending.upload.isComplete() || !m_resources.isSoftBodyBuffersResident(pending.softBody.sharedBuffers)))
+            break;
+
+        if (!pending.failed)
+        {
+            m_uploadStats.bodyCount++;
+            m_uploadStats.byteCount += pending.upload.getByteCount();
+            m_uploadStats.lastLatency = pending.upload.getLatency();
+            m_uploadStats.maxLatency = std::max(m_uploadStats.maxLatency, pending.upload.getLatency());
+            pending.upload.cleanup();
+
+            if (slot < MAX_SOFT_BODY_COUNT)
+            {
+                finaliseSoftBody(pending.softBody);
+                m_softBodies[slot++] = pending.softBody;
+            }
+            else
+                pending.softBody.cleanupBuffers(m_resources, m_pool);
+        }
+
+        m_pendingSoftBodies.pop_front();
     }
 
-    softBody.deformBuffer.init(m_device,
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        bufferSize
-    );
+    uint32_t particleCount = 0;
+    for (int i = 0; i < slot; i++)
+        particleCount += m_softBodies[i].tetMesh.getParticleCount();
+    reserveParticleGrid(particleCount);
+}
+
+void Renderer::discardPendingSoftBodies()
+{
+    for (auto& pending : m_pendingSoftBodies)
+    {
+        // The worker writes into the pending body, so it has to be done before anything is released
+        if (pending->staged.valid() && !pending->staged.get())
+            pending->failed = true;
+
+        pending->upload.cleanup();
+        if (!pending->failed)
+            pending->softBody.cleanupBuffers(m_resources, m_pool);
+    }
+    m_pendingSoftBodies.clear();
+}
+
+void Renderer::createSoftBody(PendingSoftBody& pending, SoftBodyData* softBodyData)
+{
+    SoftBody& softBody = pending.softBody;
+    UploadBatch& upload = pending.upload;
 
-    m_commandPool.copyBuffer(stagingBuffer, softBody.deformBuffer, bufferSize);
-    stagingBuffer.cleanup();
+    softBody.sharedBuffers = m_resources.acquireSoftBodyBuffers(*softBodyData, pending.resolution, upload, pending.stagesSharedBuffers);
+    SoftBodyBuffers& shared = *softBody.sharedBuffers;
 
-    softBody.deformDescriptorSet.writeBuffer(0, 5, softBody.deformBuffer);
+    softBody.mesh.init(m_device, upload, softBodyData->mesh, shared.uvBuffer, shared.indexBuffer);
+    softBody.useTetDeformation = pending.resolution != 100;
+    pending.data = softBodyData;
+
+    softBody.deformUBO.init(m_device, glm::uvec2(softBody.mesh.getVertexCount(), softBody.mesh.getIndexCount()));
+
+    const uint32_t* tetColorOffsets = softBodyData->getTetColorOffsets();
+    const uint32_t* edgeColorOffsets = softBodyData->getEdgeColorOffsets();
+    softBody.tetColorOffsets.assign(tetColorOffsets, tetColorOffsets + softBodyData->getTetColorCount() + 2);
+    softBody.edgeColorOffsets.assign(edgeColorOffsets, edgeColorOffsets + softBodyData->getEdgeColorCount() + 2);
+}
+
+void Renderer::finaliseSoftBody(SoftBody& softBody)
+{
+    softBody.graphicsDescriptorSet.init(m_device, m_tetDescriptorSetLayout, 1);
+    softBody.deformDescriptorSet.init(m_device, m_deformDescriptorSetLayout, 0);
+    writeSoftBodyDescriptors(softBody);
 
     softBody.color = COLORS[rand() % COLOR_COUNT];
+    softBody.subStepCount = 0;
     softBody.active = true;
+}
+
+void Renderer::writeSoftBodyDescriptors(SoftBody& softBody)
+{
+    TetrahedralMesh& tetMesh = softBody.tetMesh;
+
+    softBody.graphicsDescriptorSet.writeBuffer(0, 0, tetMesh.getParticleBuffer(), tetMesh.getParticleSize(), tetMesh.getParticleOffset());
+    softBody.graphicsDescriptorSet.writeBuffer(0, 1, tetMesh.getTetBuffer(), tetMesh.getTetSize(), tetMesh.getTetOffset());
+
+    softBody.deformDescriptorSet.writeBuffer(0, 0, softBody.deformUBO);
+    softBody.deformDescriptorSet.writeBuffer(0, 1, softBody.mesh.getVertexBuffer(0));
+    softBody.deformDescriptorSet.writeBuffer(0, 2, softBody.mesh.getVertexBuffer(1));
+    softBody.deformDescriptorSet.writeBuffer(0, 3, softBody.mesh.getIndexBuffer());
+    softBody.deformDescriptorSet.writeBuffer(0, 4, tetMesh.getPbdPosBuffer(), tetMesh.getPbdPosSize(), tetMesh.getPbdPosOffset());
+    softBody.deformDescriptorSet.writeBuffer(0, 5, softBody.sharedBuffers->deformBuffer);
+    softBody.deformDescriptorSet.writeBuffer(0, 6, tetMesh.getTetBuffer(), tetMesh.getTetSize(), tetMesh.getTetOffset());
+}
+
+void Renderer::writePoolDescriptors()
+{
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        m_colDescriptorSet.writeBuffer(i, 15, m_pool.getParticleBuffer());
+        m_colDescriptorSet.writeBuffer(i, 16, m_pool.getPositionBuffer());
+        m_colDescriptorSet.writeBuffer(i, 17, m_pool.getEdgeBuffer());
+        m_colDescriptorSet.writeBuffer(i, 18, m_pool.getTetBuffer());
+        m_colDescriptorSet.writeBuffer(i, 24, m_pool.getEdgeOrderBuffer());
+        m_colDescriptorSet.writeBuffer(i, 25, m_pool.getTetOrderBuffer());
+    }
 
-    return softBody;
+    for (uint32_t i = 0; i < MAX_SOFT_BODY_COUNT; i++)
+    {
+        if (!m_softBodies[i].active)
+            break;
+        writeSoftBodyDescriptors(m_softBodies[i]);
+    }
+    m_poolGeneration = m_pool.getGeneration();
 }
 
 void Renderer::recreateSwapChain()
@@ -490,6 +1399,24 @@ void Renderer::renderImGui()
         ImGui::Text("runtime: %.3f s", m_timer.getTotal());
         ImGui::Text("average delta: %.4f ms", averageDT * 1000.0f);
         ImGui::Text("average FPS: %.3f", 1.0f / averageDT);
+        ImGui::Text("uploaded bodies: %u (%.2f MB)", m_uploadStats.bodyCount, m_uploadStats.byteCount / (1024.0f * 1024.0f));
+        ImGui::Text("collider triangles: %u (%u bvh nodes)", m_colliderBVH.getTriangleCount(), m_colliderBVH.getNodeCount());
+        ImGui::Text("sdf samples: %u x %u x %u", m_sdfDims.x, m_sdfDims.y, m_sdfDims.z);
+        ImGui::Text("upload latency: %.3f ms (max %.3f ms)", m_uploadStats.lastLatency * 1000.0f, m_uploadStats.maxLatency * 1000.0f);
+        ImGui::Text("batched bodies: %u, fused bodies: %u", m_batch.bodyCount, m_batch.fusedCount);
+        ImGui::Text("dropped contacts: %u static, %u body", m_droppedContacts.staticDropped, m_droppedContacts.bodyDropped);
+        if (!m_solveQueryPools.empty())
+            ImGui::Text("constraint solve: %.3f ms (gpu, %s)", m_solveTime, m_coloredSolve ? "coloured" : "atomic");
+        ImGui::Text("solve dispatches per substep: %u coloured, 2 atomic", m_batch.coloredDispatches);
+
+        std::string subSteps;
+        for (auto& softBody : m_softBodies)
+        {
+            if (!softBody.active)
+                break;
+            subSteps += (subSteps.empty() ? "" : " ") + std::to_string(softBody.subStepCount);
+        }
+        ImGui::TextWrapped("substeps per body: %s", subSteps.c_str());
 
         ImGui::End();
 
@@ -498,14 +1425,55 @@ void Renderer::renderImGui()
         ImGui::Begin("Physics Settings");
 
         ImGui::SliderInt("Fixed time step (fps)", &m_fixedTimeStep, 10, 240);
-        ImGui::SliderInt("Substep count", &m_subSteps, 1, 25);
+        ImGui::Checkbox("Adaptive substeps", &m_adaptiveSubsteps);
+        if (m_adaptiveSubsteps)
+        {
+            ImGui::DragIntRange2("Substep budget", &m_minSubSteps, &m_maxSubSteps, 0.1f, 1, 25);
+            ImGui::SliderFloat("Target residual", &m_targetResidual, 0.0001f, 0.05f, "%.4f", ImGuiSliderFlags_Logarithmic);
+        }
+        else
+            ImGui::SliderInt("Substep count", &m_subSteps, 1, 25);
         ImGui::SliderFloat("Edge compliance", &pbd.edgeCompliance, 0.0f, 1.0f);
         ImGui::SliderFloat("Volume compliance", &pbd.volumeCompliance, 0.0f, 1.0f);
+        ImGui::Checkbox("Coloured solve", &m_coloredSolve);
+        if (m_fusedSubstepsSupported)
+        {
+            std::string label = "Fused substeps (up to " + std::to_string(m_fusedParticleCount) + " particles)";
+            ImGui::Checkbox(label.c_str(), &m_fusedSubsteps);
+        }
         ImGui::Checkbox("Render wireframe", &m_renderTetMesh);
+        ImGui::Checkbox("Body collisions", &m_bodyCollisions);
+        ImGui::Checkbox("Substep collision detection", &m_substepDetection);
+        ImGui::SliderFloat("Contact distance", &m_contactDistance, 0.01f, 0.5f);
+
+        if (ImGui::CollapsingHeader("Primitive colliders"))
+        {
+            static const char* PRIMITIVE_TYPE_NAMES[COLLIDER_PRIMITIVE_TYPE_COUNT] = { "Plane", "Sphere", "Capsule", "Box" };
+            for (size_t i = 0; i < m_primitives.size(); i++)
+            {
+                PrimitiveCollider& primitive = m_primitives[i];
+                ImGui::PushID((int)i);
+                int type = (int)primitive.type;
+                if (ImGui::Combo("Type", &type, PRIMITIVE_TYPE_NAMES, COLLIDER_PRIMITIVE_TYPE_COUNT))
+                    primitive.type = (ColliderPrimitiveType)type;
+                ImGui::DragFloat3("Center", (float*)&primitive.center, 0.05f);
+                ImGui::DragFloat3("Extents", (float*)&primitive.extents, 0.05f, 0.0f, 100.0f);
+                ImGui::SliderFloat3("Rotation", (float*)&primitive.rotation, -180.0f, 180.0f);
+                bool remove = ImGui::Button("Remove");
+                ImGui::Separator();
+                ImGui::PopID();
+
+                if (remove)
+                    m_primitives.erase(m_primitives.begin() + i--);
+            }
+
+            if (ImGui::Button("Add primitive") && m_primitives.size() < MAX_COLLIDER_PRIMITIVE_COUNT)
+                m_primitives.push_back({ COLLIDER_PRIMITIVE_SPHERE, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f), glm::vec3(0.0f) });
+        }
 
         float timeStep = 1.0f / (float)m_fixedTimeStep;
         m_timer.setFixedDT(timeStep);
-        pbd.deltaTime = timeStep / m_subSteps;
+        pbd.stepTime = timeStep;
 
         m_pbdUBO[currentFrame].get() = pbd;
         m_pbdUBO[currentFrame].update();
@@ -533,13 +1501,30 @@ void Renderer::renderImGui()
         ImGui::SliderFloat("Metallic", &m_floorMaterial.metallic, 0.0f, 1.0f);
         ImGui::PopID();
 
+        ImGui::Text("Static collider");
+        ImGui::PushID(1);
+        ImGui::InputText("Name", m_colliderName, 25);
+        bool colliderInputActive = ImGui::IsItemActive();
+        if (ImGui::Button("Load"))
+            m_loadCollider = true;
+        ImGui::PopID();
+
+        ImGui::Text("Signed distance field collider");
+        ImGui::PushID(2);
+        ImGui::InputText("Name", m_sdfName, 25);
+        colliderInputActive |= ImGui::IsItemActive();
+        ImGui::SliderInt("Resolution", &m_sdfResolution, 16, 256);
+        if (ImGui::Button("Load"))
+            m_loadSdf = true;
+        ImGui::PopID();
+
         ImGui::Text("Main Material");
         ImGui::SliderFloat("Roughness", &m_material.roughness, 0.0f, 1.0f);
         ImGui::SliderFloat("Metallic", &m_material.metallic, 0.0f, 1.0f);
 
         ImGui::Text("Soft body model");
         ImGui::InputText("Name", m_modelName, 25);
-        takeInput = !ImGui::IsItemActive();
+        takeInput = !ImGui::IsItemActive() && !colliderInputActive;
         ImGui::SliderInt("Resolution", &m_modelResolution, 1, 100);
         ImGui::SliderFloat3("Start offset", (float*)&m_offset, 0.0f, 10.0f);
         ImGui::SliderInt("Number of bodies", &m_modelCount, 1, MAX_SOFT_BODY_COUNT);
@@ -573,6 +1558,13 @@ void Renderer::renderImGui()
             m_loadSoftBodies = 1;
         }
         ImGui::SameLine();
+        if (!m_solveQueryPools.empty())
+        {
+            ImGui::SameLine();
+            if (ImGui::Button("Measure Solve") && m_measureFrameCounter == MAX_FRAME_MEASUREMENT_COUNT && !m_measureSolve)
+                startSolveMeasurement();
+        }
+        ImGui::SameLine();
         if (ImGui::Button("Measure Error") && m_measureFrameCounter == MAX_FRAME_MEASUREMENT_COUNT)
         {
             m_avgError = std::vector<float>(m_frameCount, 0.0f);
@@ -726,45 +1718,79 @@ void Renderer::init(Window& window)
         VERTEX_STREAM_INPUT_NONE
     );
 
-    m_pbdDescriptorSetLayout.init(m_device,
-    {
-        {
-            { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
-        },
-        {
-            { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
-            { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
-            { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
-            { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
-            { 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT }
-        }
-    });
-    m_pbdDescriptorSet.init(m_device, m_pbdDescriptorSetLayout, 0, MAX_FRAMES_IN_FLIGHT);
-    m_pbdPipelineLayout.init(m_device, &m_pbdDescriptorSetLayout);
-    m_presolvePipeline.initCompute(m_device, m_pbdPipelineLayout, "assets/spv/presolve.comp.spv");
-    m_stretchConstraintPipeline.initCompute(m_device, m_pbdPipelineLayout, "assets/spv/stretch_constraint.comp.spv");
-    m_volumeConstraintPipeline.initCompute(m_device, m_pbdPipelineLayout, "assets/spv/volume_constraint.comp.spv");
-    m_postsolvePipeline.initCompute(m_device, m_pbdPipelineLayout, "assets/spv/postsolve.comp.spv");
-
     m_colDescriptorSetLayout.init(m_device,
     {
-        {
-            { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
-            { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
-            { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT }
-        },
         {
             { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
             { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
             { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
             { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
-            { 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT }
+            { 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 9, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 11, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 12, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 13, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 14, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 15, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 16, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 17, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 18, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 19, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 20, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 21, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 22, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 23, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 24, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT },
+            { 25, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT }
         }
     });
     m_colDescriptorSet.init(m_device, m_colDescriptorSetLayout, 0, MAX_FRAMES_IN_FLIGHT);
-    m_colPipelineLayout.init(m_device, &m_colDescriptorSetLayout);
-    m_staticColDetectionPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/static_collision_detection.comp.spv");
-    m_colConstraintPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/collision_constraint.comp.spv");
+    m_colPipelineLayout.init(m_device, &m_colDescriptorSetLayout, sizeof(BodyPushConstants), VK_SHADER_STAGE_COMPUTE_BIT);
+
+    // Limits shared by the collision shaders, by constant_id
+    const std::vector<uint32_t> colConstants = {
+        MAX_SOFT_BODY_COUNT,
+        MAX_COLLISION_CONSTRAINT_COUNT,
+        MAX_BODY_CONTACT_COUNT,
+        COL_SIZE_STRIDE / sizeof(uint32_t)
+    };
+    m_staticColDetectionPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/static_collision_detection.comp.spv", colConstants);
+    m_colConstraintPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/collision_constraint.comp.spv", colConstants);
+    m_particleHashPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/particle_hash.comp.spv");
+    m_prefixScanPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/prefix_scan.comp.spv");
+    m_prefixScanBlocksPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/prefix_scan_blocks.comp.spv");
+    m_prefixScanAddPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/prefix_scan_add.comp.spv");
+    m_particleScatterPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/particle_scatter.comp.spv");
+    m_particleColDetectionPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/particle_collision_detection.comp.spv", colConstants);
+    m_particleBoundsPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/particle_bounds.comp.spv");
+    m_bodyBroadphasePipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/body_broadphase.comp.spv", colConstants);
+    m_sdfCollisionPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/sdf_collision.comp.spv");
+    m_primitiveCollisionPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/primitive_collision.comp.spv");
+
+    // The batched solver stages read the soft body pool through set 0
+    m_presolvePipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/presolve.comp.spv");
+    m_stretchConstraintPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/stretch_constraint.comp.spv");
+    m_volumeConstraintPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/volume_constraint.comp.spv");
+    m_stretchConstraintColoredPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/stretch_constraint_colored.comp.spv");
+    m_volumeConstraintColoredPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/volume_constraint_colored.comp.spv");
+    m_postsolvePipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/postsolve.comp.spv", colConstants);
+    m_bodyResidualPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/body_residual.comp.spv");
+
+    // Every thread of the fused kernel integrates the same number of particles
+    m_fusedParticleCount = std::min(m_device.getMaxComputeSharedMemorySize() / (uint32_t)FUSED_PARTICLE_SIZE, (uint32_t)MAX_FUSED_PARTICLE_COUNT);
+    m_fusedParticleCount -= m_fusedParticleCount % FUSED_GROUP_SIZE;
+    m_fusedSubstepsSupported = m_device.supportsSharedFloatAtomics() && m_fusedParticleCount > 0;
+    if (m_fusedSubstepsSupported)
+    {
+        std::vector<uint32_t> fusedConstants = colConstants;
+        fusedConstants.push_back(m_fusedParticleCount);
+        m_fusedSubstepPipeline.initCompute(m_device, m_colPipelineLayout, "assets/spv/substep_fused.comp.spv", fusedConstants);
+    }
 
     m_deformDescriptorSetLayout.init(m_device,
     {
@@ -790,13 +1816,12 @@ void Renderer::init(Window& window)
     m_colUBO.resize(MAX_FRAMES_IN_FLIGHT);
 
     float dt = 1.0f / (float)m_fixedTimeStep;
-    float subdt = dt / m_subSteps;
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
         m_matricesUBO[i].init(m_device, {});
         m_graphicsUBO[i].init(m_device, graphics);
-        m_pbdUBO[i].init(m_device, { subdt, 0.01f, 0.0f });
-        m_colUBO[i].init(m_device, { dt, 0 });
+        m_pbdUBO[i].init(m_device, { dt, 0.01f, 0.0f });
+        m_colUBO[i].init(m_device, { dt, 0, 0, 0, m_contactDistance, 0, 0 });
     }
 
     m_commandPool.init(m_device, VK_PIPELINE_BIND_POINT_GRAPHICS);
@@ -810,7 +1835,9 @@ void Renderer::init(Window& window)
     m_imGuiRenderer.init(window, m_instance, m_device, m_swapChain, m_commandPool);
     m_shadowRenderer.init(m_device, m_swapChain, m_commandPool, 2048);
     m_shadowSampler.init(m_device, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER, VK_SAMPLER_MIPMAP_MODE_NEAREST);
-    m_resources.init(m_device, m_commandPool);
+    m_threadPool.init();
+    m_resources.init(m_device, m_commandPool, m_threadPool);
+    m_pool.init(m_device, m_commandPool);
 
     createResources();
 
@@ -822,11 +1849,20 @@ void Renderer::init(Window& window)
         m_graphicsDescriptorSet.writeBuffer(i, 0, m_matricesUBO[i]);
         m_graphicsDescriptorSet.writeBuffer(i, 1, m_graphicsUBO[i]);
         m_graphicsDescriptorSet.writeTexture(i, 2, m_shadowRenderer.getDepthTexture(), m_shadowSampler);
-        m_pbdDescriptorSet.writeBuffer(i, 0, m_pbdUBO[i]);
         m_colDescriptorSet.writeBuffer(i, 0, m_colUBO[i]);
-        m_colDescriptorSet.writeBuffer(i, 1, m_colPositionsBuffer);
-        m_colDescriptorSet.writeBuffer(i, 2, m_colIndicesBuffer);
+        m_colDescriptorSet.writeBuffer(i, 8, m_bodyBoundsBuffer);
+        m_colDescriptorSet.writeBuffer(i, 9, m_bodyPairsBuffer);
+        m_colDescriptorSet.writeBuffer(i, 10, m_bodyDispatchBuffer);
+        m_colDescriptorSet.writeBuffer(i, 12, m_primitiveBuffer[i]);
+        m_colDescriptorSet.writeBuffer(i, 13, m_pbdUBO[i]);
+        m_colDescriptorSet.writeBuffer(i, 14, m_bodyTableBuffer[i]);
+        m_colDescriptorSet.writeBuffer(i, 23, m_bodyColorBuffer[i]);
+        m_colDescriptorSet.writeBuffer(i, 19, m_colSizeBuffer[i]);
+        m_colDescriptorSet.writeBuffer(i, 20, m_colConstraintBuffer[i]);
+        m_colDescriptorSet.writeBuffer(i, 21, m_bodyResidualBuffer[i]);
+        m_colDescriptorSet.writeBuffer(i, 22, m_colOverflowBuffer[i]);
     }
+    writePoolDescriptors();
 
     m_timer.init(1.0f / m_fixedTimeStep);
 }
@@ -839,11 +1875,48 @@ void Renderer::cleanup()
     m_shadowRenderer.cleanup();
     m_imGuiRenderer.cleanup();
 
+    discardPendingSoftBodies();
+    if (m_pendingSdf)
+        m_pendingSdf->baked.wait();
     for (auto& softBody : m_softBodies)
-        softBody.cleanup();
+        softBody.cleanup(m_resources, m_pool);
+    m_threadPool.cleanup();
+    m_resources.cleanup();
+    m_pool.cleanup();
 
-    m_colIndicesBuffer.cleanup();
-    m_colPositionsBuffer.cleanup();
+    if (m_gridCapacity > 0)
+    {
+        m_gridBlockSumsBuffer.cleanup();
+        m_gridCellEntriesBuffer.cleanup();
+        m_gridCellStartBuffer.cleanup();
+        m_gridCellsBuffer.cleanup();
+        m_gridPositionsBuffer.cleanup();
+    }
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        m_bodyResidualBuffer[i].unmap();
+        m_bodyResidualBuffer[i].cleanup();
+        m_colOverflowBuffer[i].unmap();
+        m_colOverflowBuffer[i].cleanup();
+        m_colConstraintBuffer[i].cleanup();
+        m_colSizeBuffer[i].cleanup();
+        m_bodyColorBuffer[i].unmap();
+        m_bodyColorBuffer[i].cleanup();
+        m_bodyTableBuffer[i].unmap();
+        m_bodyTableBuffer[i].cleanup();
+        m_primitiveBuffer[i].unmap();
+        m_primitiveBuffer[i].cleanup();
+    }
+    m_bodyDispatchBuffer.cleanup();
+    m_bodyPairsBuffer.cleanup();
+    m_bodyBoundsBuffer.cleanup();
+    if (m_renderCollider)
+        m_colliderMesh.cleanup();
+    if (m_sdfMeshData.indices.size() > 0)
+        m_sdfMesh.cleanup();
+    m_sdfBuffer.cleanup();
+    m_colTrianglesBuffer.cleanup();
+    m_colNodesBuffer.cleanup();
 
     m_floorTexture.cleanup();
     m_floorMesh.cleanup();
@@ -856,6 +1929,8 @@ void Renderer::cleanup()
     {
         vkDestroySemaphore(device, m_computeFinishedSemaphores[i], nullptr);
         vkDestroyFence(device, m_computeInFlightFences[i], nullptr);
+        if (!m_solveQueryPools.empty())
+            vkDestroyQueryPool(device, m_solveQueryPools[i], nullptr);
 
         vkDestroySemaphore(device, m_renderFinishedSemaphores[i], nullptr);
         vkDestroySemaphore(device, m_imageAvailableSemaphores[i], nullptr);
@@ -883,20 +1958,31 @@ void Renderer::cleanup()
     m_deformPipelineLayout.cleanup();
     m_deformDescriptorSetLayout.cleanup();
 
+    if (m_fusedSubstepsSupported)
+        m_fusedSubstepPipeline.cleanup();
+    m_primitiveCollisionPipeline.cleanup();
+    m_sdfCollisionPipeline.cleanup();
+    m_bodyBroadphasePipeline.cleanup();
+    m_particleBoundsPipeline.cleanup();
+    m_particleColDetectionPipeline.cleanup();
+    m_particleScatterPipeline.cleanup();
+    m_prefixScanAddPipeline.cleanup();
+    m_prefixScanBlocksPipeline.cleanup();
+    m_prefixScanPipeline.cleanup();
+    m_particleHashPipeline.cleanup();
     m_colConstraintPipeline.cleanup();
     m_staticColDetectionPipeline.cleanup();
     m_colPipelineLayout.cleanup();
     m_colDescriptorSet.cleanup();
     m_colDescriptorSetLayout.cleanup();
 
+    m_bodyResidualPipeline.cleanup();
     m_postsolvePipeline.cleanup();
+    m_volumeConstraintColoredPipeline.cleanup();
+    m_stretchConstraintColoredPipeline.cleanup();
     m_volumeConstraintPipeline.cleanup();
     m_stretchConstraintPipeline.cleanup();
     m_presolvePipeline.cleanup();
-    m_pbdPipelineLayout.cleanup();
-
-    m_pbdDescriptorSet.cleanup();
-    m_pbdDescriptorSetLayout.cleanup();
 
     m_tetPipeline.cleanup();
     m_tetPipelineLayout.cleanup();
@@ -919,21 +2005,34 @@ void Renderer::cleanup()
 
 void Renderer::render()
 {
+    if (m_loadCollider)
+    {
+        loadStaticCollider(m_colliderName);
+        m_loadCollider = false;
+        m_timer.reset();
+    }
+    finaliseSdfCollider();
+    if (m_loadSdf && !m_pendingSdf)
+    {
+        loadSdfCollider(m_sdfName, (uint32_t)m_sdfResolution);
+        m_loadSdf = false;
+    }
     if (!m_removeBodies.empty())
     {
         vkQueueWaitIdle(m_device.getComputeQueue());
         vkQueueWaitIdle(m_device.getGraphicsQueue());
 
         for (auto& softBody : m_removeBodies)
-            softBody->cleanup();
+            softBody->cleanup(m_resources, m_pool);
         m_removeBodies.clear();
         m_timer.reset();
     }
     if (m_loadSoftBodies == 1) // Normal load
     {
+        discardPendingSoftBodies();
         if (m_modelCount == 1)
         {
-            m_softBodies[0] = createSoftBody(m_modelName, m_offset, m_modelResolution);
+            loadSoftBody(m_modelName, m_offset, m_modelResolution);
         }
         else
         {
@@ -944,20 +2043,30 @@ void Renderer::render()
                 glm::vec3 dir = glm::vec3(sin(angle * i), 0.0f, cos(angle * i));
                 glm::vec3 startOffset = dir * (float)(dist * log(i + 2));
                 startOffset.y = ((rand() % 1001) * 0.001f) * (m_offset.y - 1) + 1;
-                m_softBodies[i] = createSoftBody(m_modelName, startOffset, m_modelResolution);
+                loadSoftBody(m_modelName, startOffset, m_modelResolution);
             }
         }
 
         m_loadSoftBodies = 0;
-        m_timer.reset();
     }
     else if (m_loadSoftBodies == 2) // Error measuring
     {
-        m_softBodies[0] = createSoftBody(m_modelName, m_offset, 100);
-        m_softBodies[1] = createSoftBody(m_modelName, m_offset, m_modelResolution);
+        discardPendingSoftBodies();
+        loadSoftBody(m_modelName, m_offset, 100);
+        loadSoftBody(m_modelName, m_offset, m_modelResolution);
 
         m_loadSoftBodies = 0;
-        m_timer.reset();
+    }
+
+    if (!m_pendingSoftBodies.empty())
+    {
+        finaliseSoftBodies();
+
+        // Restart the timer once everything is loaded so that measurements start with a full scene
+        if (m_pendingSoftBodies.empty())
+            m_timer.reset();
+        else
+            m_timer.update();
     }
     else
         m_timer.update();
@@ -971,36 +2080,49 @@ void Renderer::render()
     vkResetFences(device, 1, &m_computeInFlightFences[currentFrame]);
 
     m_computeCommandBufferArray.begin(currentFrame);
+    updateSolveTimes(m_computeCommandBufferArray[currentFrame]);
     if (m_timer.passedFixedDT())
     {
-        for (auto& softBody : m_softBodies)
-        {
-            if (!softBody.active)
-                break;
-
-            /*softBody.colSizeBuffer.map();
-            uint32_t size = *(uint32_t*)softBody.colSizeBuffer.getMapped();
-            softBody.colSizeBuffer.unmap();
-
-            std::cout << "Col size: " << size << "\n";*/
-            detectCollisions(m_computeCommandBufferArray[currentFrame], softBody);
-        }
-
-
-
-        for (auto& softBody : m_softBodies)
-        {
-            if (!softBody.active)
-                break;
-
-            for (int i = 0; i < m_subSteps; i++)
-                computePhysics(m_computeCommandBufferArray[currentFrame], softBody);
-
-            deformMesh(m_computeCommandBufferArray[currentFrame], softBody);
-        }
+        updatePrimitiveColliders();
+        updateSubSteps();
+        readCollisionOverflow();
+        updateBodyTable();
+        resetCollisions(m_computeCommandBufferArray[currentFrame]);
+
+        // Fused bodies keep their per frame detection, their substeps never leave the fused kernel
+        if (m_substepDetection)
+            detectCollisions(m_computeCommandBufferArray[currentFrame], m_batch.bodyCount, m_batch.fusedCount, m_batch.fusedParticleGroups, false);
+        else
+            detectCollisions(m_computeCommandBufferArray[currentFrame], 0, m_batch.bodyCount + m_batch.fusedCount,
+                std::max(m_batch.particleGroups, m_batch.fusedParticleGroups), false);
+        detectBodyCollisions(m_computeCommandBufferArray[currentFrame]);
+        saveCollisionSizes(m_computeCommandBufferArray[currentFrame]);
+
+        // The collision solve reads its group counts from the detection results
+        VkMemoryBarrier memoryBarrier = {};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(m_computeCommandBufferArray[currentFrame],
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            0,
+            1,
+            &memoryBarrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+
+        computePhysicsFused(m_computeCommandBufferArray[currentFrame]);
+        for (uint32_t i = 0; i < m_batch.maxSubSteps; i++)
+            computePhysics(m_computeCommandBufferArray[currentFrame], i);
+        reduceBodyResiduals(m_computeCommandBufferArray[currentFrame]);
+
+        deformMeshes(m_computeCommandBufferArray[currentFrame]);
 
         // Measurements
-        if (m_measureFrameCounter < MAX_FRAME_MEASUREMENT_COUNT)
+        if (m_measureFrameCounter < MAX_FRAME_MEASUREMENT_COUNT && m_pendingSoftBodies.empty())
         {
             if (m_measureFPS)
             {
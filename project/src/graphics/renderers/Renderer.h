@@ -6,7 +6,9 @@
 #include "../CommandPool.h"
 #include "../CommandBufferArray.h"
 #include "../Buffer.h"
+#include "../UploadBatch.h"
 #include "resources/Mesh.h"
+#include "resources/TriangleBVH.h"
 #include "../pipeline/Pipeline.h"
 #include "../pipeline/UniformBuffer.h"
 #include "../pipeline/Sampler.h"
@@ -16,6 +18,7 @@
 #include "resources/ResourceManager.h"
 #include "core/Timer.h"
 #include "core/Camera.h"
+#include "core/ThreadPool.h"
 
 struct MatricesUBO
 {
@@ -35,7 +38,7 @@ struct GraphicsUBO
 
 struct PbdUBO
 {
-	float deltaTime;
+	float stepTime; // Fixed step, every body splits it into its own substep count
 	float edgeCompliance;
 	float volumeCompliance;
 };
@@ -51,6 +54,69 @@ struct ColDetectionUBO
 {
 	float deltaTime;
 	uint32_t triCount;
+
+	// Particle grid over all active bodies
+	uint32_t particleCount;
+	uint32_t tableSize;
+	float contactDistance;
+	uint32_t bodyCount;
+	uint32_t primitiveCount;
+};
+
+// Push constants of the batched collision and solver pipelines
+struct BodyPushConstants
+{
+	uint32_t subStep; // Substep of a batched pass, bodies with fewer substeps skip the indirect collision solve
+	uint32_t firstBody; // First body table entry of a batched dispatch
+	uint32_t substepDetection; // The static detection covers one substep of each body instead of the whole step
+	uint32_t color; // Colour of a coloured constraint pass, MAX_CONSTRAINT_COLORS for the uncoloured remainder
+};
+
+// Entry of the body table, matches Body in the batched solver shaders. Batched dispatches run one row of workgroups per entry
+struct BatchedBody
+{
+	SoftBodyRange range;
+	uint32_t slot; // Index of the collision constraints and size of the body
+	uint32_t subStepCount;
+};
+
+// Colour ranges of a body table entry, matches BodyColors in the coloured constraint shaders. Colour c is offsets[c] to offsets[c + 1]
+// of the colour order, colours the body does not have are empty and the last range is the uncoloured remainder
+struct BodyColors
+{
+	uint32_t edgeOffsets[ResourceManager::MAX_CONSTRAINT_COLORS + 2];
+	uint32_t tetOffsets[ResourceManager::MAX_CONSTRAINT_COLORS + 2];
+};
+
+// Reduced by body_residual after the last substep and read back a frame later, indexed by body slot
+struct BodyResidual
+{
+	float residual; // Largest relative edge length or volume error
+	float maxSpeed;
+};
+
+// Contacts the detection could not store because the range of their body slot was full, counted over a frame
+struct CollisionOverflow
+{
+	uint32_t staticDropped = 0;
+	uint32_t bodyDropped = 0;
+};
+
+// Sizes of the batched dispatches, the groups along x cover the largest body
+struct BatchedDispatch
+{
+	uint32_t bodyCount = 0; // Bodies solved stage by stage, the first entries of the body table
+	uint32_t fusedCount = 0; // Bodies solved by the fused substep kernel, the entries after them
+	uint32_t particleGroups = 0;
+	uint32_t fusedParticleGroups = 0;
+	uint32_t edgeGroups = 0;
+	uint32_t tetGroups = 0;
+	uint32_t residualGroups = 0; // Covers the particles, edges and tetrahedra of every body in the table
+	// Groups of every colour and of the uncoloured remainder, each covers the largest range of any batched body
+	std::array<uint32_t, ResourceManager::MAX_CONSTRAINT_COLORS + 1> edgeColorGroups{};
+	std::array<uint32_t, ResourceManager::MAX_CONSTRAINT_COLORS + 1> tetColorGroups{};
+	uint32_t coloredDispatches = 0; // Of the coloured constraint solve in one substep, a dispatch per non empty colour and type
+	uint32_t maxSubSteps = 0; // Batched bodies are sorted by substep count, later passes have fewer rows
 };
 
 struct ColConstraint
@@ -60,61 +126,125 @@ struct ColConstraint
 	alignas(16) glm::vec3 normal;
 };
 
+enum ColliderPrimitiveType
+{
+	COLLIDER_PRIMITIVE_PLANE = 0,
+	COLLIDER_PRIMITIVE_SPHERE = 1,
+	COLLIDER_PRIMITIVE_CAPSULE = 2,
+	COLLIDER_PRIMITIVE_BOX = 3,
+	COLLIDER_PRIMITIVE_TYPE_COUNT
+};
+
+// Analytic collider as edited on the cpu. Planes face local +y, spheres use extents.x as radius and
+// capsules run along local y with extents.x as radius and extents.y as half height
+struct PrimitiveCollider
+{
+	ColliderPrimitiveType type;
+	glm::vec3 center;
+	glm::vec3 extents;
+	glm::vec3 rotation; // Euler angles in degrees
+};
+
+// Matches Primitive in primitive_collision
+struct ColliderPrimitive
+{
+	glm::vec3 center;
+	uint32_t type;
+	alignas(16) glm::vec3 extents;
+	alignas(16) glm::vec4 rotation; // Quaternion, xyz is the vector part
+};
+
 struct SoftBody
 {
 	Mesh mesh;
 	TetrahedralMesh tetMesh;
 
+	// Index, uv and deformation buffers and the topology range, owned by the resource manager
+	SoftBodyBuffers* sharedBuffers = nullptr;
+
 	DescriptorSet graphicsDescriptorSet;
-	DescriptorSet pbdDescriptorSet;
-	DescriptorSet colDescriptorSet;
 	DescriptorSet deformDescriptorSet;
 
-	// Buffer used to deform the original mesh, either directly in the form of indices or in the form of tetrahedral deformation
-	Buffer deformBuffer;
+	// UBO information in deform shaders
+	UniformBuffer<glm::uvec2> deformUBO; // (vertexCount, indexCount)
 
-	// Collision buffers
-	std::vector<Buffer> colSizeBuffer;
-	std::vector<Buffer> colConstraintBuffer;
+	// Start of each constraint colour in the colour order, then of the uncoloured remainder and the constraint count
+	std::vector<uint32_t> tetColorOffsets;
+	std::vector<uint32_t> edgeColorOffsets;
 
-	// UBO information in pbd and deform shaders
-	UniformBuffer<glm::uvec3> pbdUBO; // (particleCount, edgeCount, tetrahedralCount)
-	UniformBuffer<glm::uvec2> deformUBO; // (vertexCount, indexCount)
+	uint32_t subStepCount = 0; // 0 until the first count is chosen
 
 	bool active = false;
 	bool useTetDeformation = false;
 	glm::vec3 color;
 
-	void cleanup()
+	void cleanupBuffers(ResourceManager& resources, SoftBodyPool& pool)
+	{
+		deformUBO.cleanup();
+		tetMesh.cleanup();
+		mesh.cleanup();
+		resources.releaseSoftBodyBuffers(sharedBuffers, pool);
+	}
+
+	void cleanup(ResourceManager& resources, SoftBodyPool& pool)
 	{
 		if (active)
 		{
-			for (int i = 0, len = (int)colConstraintBuffer.size(); i < len; i++)
-			{
-				colConstraintBuffer[i].cleanup();
-				colSizeBuffer[i].cleanup();
-			}
-			deformBuffer.cleanup();
 			deformDescriptorSet.cleanup();
-			colDescriptorSet.cleanup();
-			pbdDescriptorSet.cleanup();
 			graphicsDescriptorSet.cleanup();
-			deformUBO.cleanup();
-			pbdUBO.cleanup();
-			tetMesh.cleanup();
-			mesh.cleanup();
+			cleanupBuffers(resources, pool);
 		}
 		active = false;
 	}
 };
 
+// Soft body whose data is being loaded and staged on a worker thread, then uploaded in a single submission
+struct PendingSoftBody
+{
+	std::future<bool> staged; // Buffers created and staging filled, false if the data failed to load
+	SoftBody softBody;
+	SoftBodyData* data = nullptr; // The particles, and the topology of a first instance, are staged into the soft body pool on submit
+	UploadBatch upload;
+	glm::vec3 offset;
+	int resolution;
+	bool failed = false;
+	bool stagesSharedBuffers = false; // First instance of its model, the shared buffers are part of its upload
+};
+
+// Signed distance field collider baked or read from the cache on a worker thread, the current one stays in use until it is ready
+struct PendingSdfCollider
+{
+	std::future<bool> baked; // False if the field failed to load
+	std::string name;
+	SignedDistanceFieldData sdf;
+	MeshData mesh;
+};
+
+// Accumulated since start up
+struct UploadStats
+{
+	uint32_t bodyCount = 0;
+	VkDeviceSize byteCount = 0;
+	float lastLatency = 0.0f;
+	float maxLatency = 0.0f;
+};
+
 class Renderer
 {
 public:
 	const static int MAX_FRAMES_IN_FLIGHT = 2;
 	const static int MAX_SOFT_BODY_COUNT = 50;
 	const static int MAX_FRAME_MEASUREMENT_COUNT = 1000;
+	const static int MAX_TIMED_SUBSTEP_COUNT = 32; // Substeps of a frame whose constraint solve gets timestamps
 	const static int MAX_COLLISION_CONSTRAINT_COUNT = 10000;
+	const static int MAX_BODY_CONTACT_COUNT = 10000; // Contacts with other bodies get their own range after the static collision constraints of a slot
+	const static int MAX_SOFT_BODY_UPLOADS_PER_FRAME = 4;
+	const static int MAX_COLLIDER_PRIMITIVE_COUNT = 256;
+	const static int GRID_SCAN_BLOCK_SIZE = 512; // Cells scanned per workgroup, matches blockSize in the prefix scan shaders
+	const static int FUSED_GROUP_SIZE = 256; // Matches groupSize in substep_fused
+	const static int FUSED_PARTICLE_SIZE = 6 * sizeof(float); // Shared memory per particle of a fused body, its prediction and delta
+	const static int MAX_FUSED_PARTICLE_COUNT = 2048; // Bounds the integration state every fused thread keeps in registers
+	const static int COL_SIZE_STRIDE = 256; // Bytes between the collision sizes of two bodies, a valid descriptor offset alignment on every device
 
 	const static int COLOR_COUNT = 7;
 	inline const static glm::vec3 COLORS[COLOR_COUNT] = 
@@ -131,10 +261,21 @@ private:
 	uint32_t currentFrame;
 	Timer m_timer;
 	Camera m_camera;
+	ThreadPool m_threadPool;
 	ResourceManager m_resources;
 
 	int m_fixedTimeStep = 60;
 	int m_subSteps = 20;
+
+	// Per body substep counts chosen from the residuals of the frame before last, within [m_minSubSteps, m_maxSubSteps]
+	bool m_adaptiveSubsteps = false;
+	int m_minSubSteps = 2;
+	int m_maxSubSteps = 25;
+	float m_targetResidual = 0.005f;
+	Pipeline m_bodyResidualPipeline;
+	std::vector<Buffer> m_bodyResidualBuffer; // Per frame and persistently mapped
+	bool m_residualPending[MAX_FRAMES_IN_FLIGHT] = {};
+	bool m_coloredSolve = false; // Gauss-Seidel over constraint colours instead of the atomic Jacobi solve
 	bool m_renderTetMesh = false;
 
 	Instance m_instance;
@@ -155,13 +296,12 @@ private:
 	Pipeline m_tetPipeline;
 	DescriptorSetLayout m_tetDescriptorSetLayout;
 
-	PipelineLayout m_pbdPipelineLayout;
 	Pipeline m_presolvePipeline;
 	Pipeline m_stretchConstraintPipeline;
 	Pipeline m_volumeConstraintPipeline;
+	Pipeline m_stretchConstraintColoredPipeline;
+	Pipeline m_volumeConstraintColoredPipeline;
 	Pipeline m_postsolvePipeline;
-	DescriptorSetLayout m_pbdDescriptorSetLayout;
-	DescriptorSet m_pbdDescriptorSet;
 
 	PipelineLayout m_deformPipelineLayout;
 	DescriptorSetLayout m_deformDescriptorSetLayout;
@@ -172,18 +312,104 @@ private:
 
 	uint32_t m_loadSoftBodies = 0; // Used to load soft bodies after button has been pressed, happens after old bodies have been destroyed
 	std::array<SoftBody, MAX_SOFT_BODY_COUNT> m_softBodies;
+	SoftBodyPool m_pool;
+	uint32_t m_poolGeneration = 0; // Generation of the pool the descriptors were written with
+	std::vector<Buffer> m_bodyTableBuffer; // Per frame and persistently mapped
+	std::vector<Buffer> m_bodyColorBuffer; // Colour ranges of the body table entries, per frame and persistently mapped
+	BatchedDispatch m_batch;
+	std::deque<std::unique_ptr<PendingSoftBody>> m_pendingSoftBodies; // Activated in order once their upload has completed
+	UploadStats m_uploadStats;
 	std::vector<SoftBody*> m_removeBodies; // Removed after their execution is done
 
 	// Collision
 	std::vector<UniformBuffer<ColDetectionUBO>> m_colUBO;
-	Buffer m_colPositionsBuffer;
-	Buffer m_colIndicesBuffer;
+
+	// Static triangle collider, an optional obj mesh from assets/models in a triangle bvh
+	char m_colliderName[25] = "";
+	bool m_loadCollider = false; // Loaded at the start of the next frame, the current one may use the old collider
+	bool m_renderCollider = false;
+	bool m_colliderBuffersCreated = false;
+	MeshData m_colliderMeshData;
+	Mesh m_colliderMesh;
+	TriangleBVH m_colliderBVH;
+	Buffer m_colNodesBuffer;
+	Buffer m_colTrianglesBuffer;
+
+	// Signed distance field collider, resolved per particle every substep without collision constraints
+	char m_sdfName[25] = "";
+	int m_sdfResolution = 64;
+	bool m_loadSdf = false; // Started at the start of the next frame without a load in flight
+	std::unique_ptr<PendingSdfCollider> m_pendingSdf;
+	bool m_sdfLoaded = false;
+	bool m_sdfBufferCreated = false;
+	MeshData m_sdfMeshData;
+	Mesh m_sdfMesh;
+	glm::uvec3 m_sdfDims = glm::uvec3(0);
+	Buffer m_sdfBuffer;
+
+	// Analytic colliders, evaluated directly every substep. Kinematic, they can be moved at any time
+	std::vector<PrimitiveCollider> m_primitives = { { COLLIDER_PRIMITIVE_PLANE, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) } };
+	std::vector<Buffer> m_primitiveBuffer; // Per frame and persistently mapped
+
+	// Collision constraints of every body slot, per frame, static contacts first and then the body contacts. The sizes start with
+	// the indirect dispatch of the batched collision solve, then every slot has its static size, the saved static size and its body contact size
+	std::vector<Buffer> m_colSizeBuffer;
+	std::vector<Buffer> m_colConstraintBuffer;
+	std::vector<Buffer> m_colOverflowBuffer; // Per frame and persistently mapped
+	bool m_overflowPending[MAX_FRAMES_IN_FLIGHT] = {};
+	CollisionOverflow m_droppedContacts; // Of the last frame read back
 
 	PipelineLayout m_colPipelineLayout;
 	DescriptorSetLayout m_colDescriptorSetLayout;
 	DescriptorSet m_colDescriptorSet;
 	Pipeline m_staticColDetectionPipeline;
 	Pipeline m_colConstraintPipeline;
+	bool m_substepDetection = false; // Static collisions of the batched bodies are detected every substep instead of once per step
+
+	// Hashed grid of the predicted positions of all bodies, rebuilt every step for particle-particle contacts between bodies
+	bool m_bodyCollisions = true;
+	float m_contactDistance = 0.1f;
+	uint32_t m_gridCapacity = 0;
+	Buffer m_gridPositionsBuffer;
+	Buffer m_gridCellsBuffer;
+	Buffer m_gridCellStartBuffer;
+	Buffer m_gridCellEntriesBuffer;
+	Buffer m_gridBlockSumsBuffer;
+
+	// Broadphase, per body bounds and the overlapping pairs. The indirect dispatches of the grid and of the
+	// narrowphase are written by the broadphase, the narrowphase only tests the bodies of each overlapping pair
+	const static int PAIR_DISPATCH_OFFSET = 3; // Grid particles, scan blocks and block sums scan come first
+	Buffer m_bodyBoundsBuffer;
+	Buffer m_bodyPairsBuffer;
+	Buffer m_bodyDispatchBuffer;
+
+	Pipeline m_particleHashPipeline;
+	Pipeline m_prefixScanPipeline;
+	Pipeline m_prefixScanBlocksPipeline;
+	Pipeline m_prefixScanAddPipeline;
+	Pipeline m_particleScatterPipeline;
+	Pipeline m_particleColDetectionPipeline;
+	Pipeline m_particleBoundsPipeline;
+	Pipeline m_bodyBroadphasePipeline;
+	Pipeline m_sdfCollisionPipeline;
+	Pipeline m_primitiveCollisionPipeline;
+
+	// Single dispatch for all substeps of small bodies, needs float atomics on shared memory
+	Pipeline m_fusedSubstepPipeline;
+	bool m_fusedSubstepsSupported = false;
+	uint32_t m_fusedParticleCount = 0; // Bodies up to this size run all substeps in one workgroup, as many as the device's shared memory holds
+	bool m_fusedSubsteps = true;
+
+	// Gpu time of the constraint solve, a timestamp before and after the stretch and volume stages of every substep
+	std::vector<VkQueryPool> m_solveQueryPools; // Per frame, only created if the device supports timestamps
+	uint32_t m_solveQueryCount[MAX_FRAMES_IN_FLIGHT] = {};
+	bool m_solveQueryColored[MAX_FRAMES_IN_FLIGHT] = {}; // Solve path the frame's queries timed
+	float m_solveTime = 0.0f; // Milliseconds of the last frame read back
+
+	// Solve measurement, m_frameCount frames of the atomic solve and then of the coloured solve
+	bool m_measureSolve = false;
+	bool m_measureFusedSubsteps = false; // Restored afterwards, fused bodies would skip the solve being measured
+	std::vector<float> m_solveTimes[2]; // Atomic, coloured
 
 	// Measurement related
 	uint32_t m_measureFrameCounter = MAX_FRAME_MEASUREMENT_COUNT;
@@ -231,13 +457,54 @@ private:
 	ShadowRenderer m_shadowRenderer;
 
 	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
-	void detectCollisions(VkCommandBuffer commandBuffer, SoftBody& softBody);
-	void computePhysics(VkCommandBuffer commandBuffer, SoftBody& softBody);
-	void deformMesh(VkCommandBuffer commandBuffer, SoftBody& softBody);
+	void resetCollisions(VkCommandBuffer commandBuffer);
+	// Static collisions of bodyCount body table entries, over one substep of each body or the whole step
+	void detectCollisions(VkCommandBuffer commandBuffer, uint32_t firstBody, uint32_t bodyCount, uint32_t particleGroups, bool substep);
+	void detectBodyCollisions(VkCommandBuffer commandBuffer);
+	// Keeps the collision sizes and the group count of the solve after the per frame detection, postsolve rewinds to them after every substep
+	void saveCollisionSizes(VkCommandBuffer commandBuffer);
+	void updatePrimitiveColliders();
+	void reserveParticleGrid(uint32_t particleCount);
+	// Chooses the substep count of every body from the residuals this frame's buffers last reduced
+	void updateSubSteps();
+	// Fills the body table of the current frame and the sizes of the batched dispatches
+	void updateBodyTable();
+	// One substep of every body in the batch that has that many substeps, each stage is a single dispatch
+	void computePhysics(VkCommandBuffer commandBuffer, uint32_t subStep);
+	// Residual and max speed of every body after its last substep, read back once the frame's fence has signalled like the dropped contacts
+	void reduceBodyResiduals(VkCommandBuffer commandBuffer);
+	void readCollisionOverflow();
+	// Reads the solve timestamps the frame's fence has signalled, then resets the frame's queries
+	void updateSolveTimes(VkCommandBuffer commandBuffer);
+	void writeSolveTimestamp(VkCommandBuffer commandBuffer);
+	void startSolveMeasurement();
+	bool useFusedSubsteps(SoftBody& softBody);
+	// All substeps of every fused body in a single dispatch
+	void computePhysicsFused(VkCommandBuffer commandBuffer);
+	// One dispatch per colour index with a row per body, each colour sees the positions written by the previous one
+	void solveColored(VkCommandBuffer commandBuffer, Pipeline& pipeline, const std::array<uint32_t, ResourceManager::MAX_CONSTRAINT_COLORS + 1>& colorGroups,
+		uint32_t bodyCount);
+	// Deforms the render mesh of every active body, stage by stage
+	void deformMeshes(VkCommandBuffer commandBuffer);
 	void createSyncObjects();
 
 	void createResources();
-	SoftBody createSoftBody(const std::string& name, glm::vec3 offset, int resolution = 100);
+	// Rebuilds the static collider bvh from assets/models/<name>.obj, no triangle collider if name is empty
+	void loadStaticCollider(const std::string& name);
+	// Starts loading the signed distance field collider of assets/models/<name>.obj on a worker, none if name is empty
+	void loadSdfCollider(const std::string& name, uint32_t resolution);
+	// Swaps in the pending field once its worker is done
+	void finaliseSdfCollider();
+	void uploadSdfCollider(const SignedDistanceFieldData& sdf, MeshData mesh);
+	void loadSoftBody(const std::string& name, glm::vec3 offset, int resolution = 100);
+	void finaliseSoftBodies();
+	void discardPendingSoftBodies();
+	void createSoftBody(PendingSoftBody& pending, SoftBodyData* softBodyData);
+	void finaliseSoftBody(SoftBody& softBody);
+	// Per body views of the soft body pool
+	void writeSoftBodyDescriptors(SoftBody& softBody);
+	// Rewrites every descriptor of the pool buffers after the pool has grown
+	void writePoolDescriptors();
 
 	void recreateSwapChain();
 	void renderImGui();
@@ -1,7 +1,7 @@
 #include "pch.h"
 #include "Mesh.h"
 
-void Mesh::init(Device& device, CommandPool& commandPool, MeshData* meshData)
+void Mesh::init(Device& device, UploadBatch& upload, MeshData* meshData)
 {
     p_device = &device;
     p_meshData = meshData;
@@ -9,29 +9,45 @@ void Mesh::init(Device& device, CommandPool& commandPool, MeshData* meshData)
     m_indexCount = (uint32_t)meshData->indices.size();
 
     // Vertex buffers
-    addVertexBuffer<avec3>(commandPool, meshData->vertices.positions, true);
-    addVertexBuffer<avec3>(commandPool, meshData->vertices.normals, true);
-    addVertexBuffer<glm::vec2>(commandPool, meshData->vertices.uvs);
+    addVertexBuffer<avec3>(upload, meshData->vertices.positions, true);
+    addVertexBuffer<avec3>(upload, meshData->vertices.normals, true);
+    addVertexBuffer<glm::vec2>(upload, meshData->vertices.uvs);
 
     // Index buffer
-    Buffer stagingBuffer;
     VkDeviceSize bufferSize = sizeof(uint32_t) * m_indexCount;
-    stagingBuffer.init(device,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        bufferSize,
-        (void*)meshData->indices.data()
-    );
-
     m_indexBuffer.init(device,
         VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
         bufferSize
     );
+    upload.add(m_indexBuffer, meshData->indices.data(), bufferSize);
 
-    commandPool.copyBuffer(stagingBuffer, m_indexBuffer, bufferSize);
-    stagingBuffer.cleanup();
+    m_ownedBufferCount = (uint32_t)m_vertexBuffers.size();
+    m_sharedIndexBuffer = false;
+    initRawBuffers();
+}
 
+void Mesh::init(Device& device, UploadBatch& upload, MeshData* meshData, Buffer& uvBuffer, Buffer& indexBuffer)
+{
+    p_device = &device;
+    p_meshData = meshData;
+    m_vertexCount = (uint32_t)meshData->vertices.positions.size();
+    m_indexCount = (uint32_t)meshData->indices.size();
+
+    // Deformed every frame, so each instance needs its own
+    addVertexBuffer<avec3>(upload, meshData->vertices.positions, true);
+    addVertexBuffer<avec3>(upload, meshData->vertices.normals, true);
+    m_ownedBufferCount = (uint32_t)m_vertexBuffers.size();
+
+    if (!meshData->vertices.uvs.empty())
+        m_vertexBuffers.push_back(uvBuffer);
+    m_indexBuffer = indexBuffer;
+    m_sharedIndexBuffer = true;
+    initRawBuffers();
+}
+
+void Mesh::initRawBuffers()
+{
     m_bufferCount = (uint32_t)m_vertexBuffers.size();
     m_rawVertexBuffers.resize(m_bufferCount);
     m_offsets.resize(m_bufferCount, 0);
@@ -41,9 +57,10 @@ void Mesh::init(Device& device, CommandPool& commandPool, MeshData* meshData)
 
 void Mesh::cleanup()
 {
-    m_indexBuffer.cleanup();
-    for(auto& buffer : m_vertexBuffers)
-        buffer.cleanup();
+    if (!m_sharedIndexBuffer)
+        m_indexBuffer.cleanup();
+    for (uint32_t i = 0; i < m_ownedBufferCount; i++)
+        m_vertexBuffers[i].cleanup();
 }
 
 void Mesh::bind(VkCommandBuffer commandBuffer)
@@ -1,7 +1,7 @@
 #pragma once
 
 #include "graphics/Buffer.h"
-#include "graphics/CommandPool.h"
+#include "graphics/UploadBatch.h"
 
 enum VertexStreamInput 
 {
@@ -48,10 +48,19 @@ private:
 	std::vector<VkDeviceSize> m_offsets;
 	uint32_t m_bufferCount;
 
+	// Buffers past the owned ones and the index buffer belong to someone else when shared
+	uint32_t m_ownedBufferCount;
+	bool m_sharedIndexBuffer;
+
+	void initRawBuffers();
+
 	template <typename T>
-	void addVertexBuffer(CommandPool& commandPool, const std::vector<T>& stream, bool isSBO = false);
+	void addVertexBuffer(UploadBatch& upload, const std::vector<T>& stream, bool isSBO = false);
 public:
-	void init(Device& device, CommandPool& commandPool, MeshData* meshData);
+	// Buffers are created immediately, their contents are valid once the upload batch has completed
+	void init(Device& device, UploadBatch& upload, MeshData* meshData);
+	// Only positions and normals are owned, the uv and index buffers are shared between instances
+	void init(Device& device, UploadBatch& upload, MeshData* meshData, Buffer& uvBuffer, Buffer& indexBuffer);
 	void cleanup();
 
 	void bind(VkCommandBuffer commandBuffer);
@@ -63,20 +72,12 @@ public:
 };
 
 template<typename T>
-inline void Mesh::addVertexBuffer(CommandPool& commandPool, const std::vector<T>& stream, bool isSBO)
+inline void Mesh::addVertexBuffer(UploadBatch& upload, const std::vector<T>& stream, bool isSBO)
 {
 	if (stream.size() == 0)
 		return;
 
 	VkDeviceSize bufferSize = sizeof(T) * stream.size();
-	Buffer stagingBuffer;
-	stagingBuffer.init(*p_device,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		bufferSize,
-		(void*)stream.data()
-	);
-
 	m_vertexBuffers.push_back(Buffer());
 	m_vertexBuffers.back().init(*p_device,
 		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | isSBO * VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
@@ -84,7 +85,5 @@ inline void Mesh::addVertexBuffer(CommandPool& commandPool, const std::vector<T>
 		bufferSize
 	);
 
-	commandPool.copyBuffer(stagingBuffer, m_vertexBuffers.back(), bufferSize);
-
-	stagingBuffer.cleanup();
+	upload.add(m_vertexBuffers.back(), stream.data(), bufferSize);
 }
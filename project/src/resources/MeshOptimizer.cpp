@@ -0,0 +1,185 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+
+// Next fanning vertex for Tipsify: the candidate that stays in cache the longest while its remaining triangles are emitted,
+// otherwise the most recent dead end or the next vertex with triangles left
+static int32_t nextVertex(
+    const std::vector<uint32_t>& candidates,
+    const std::vector<uint32_t>& liveCount,
+    const std::vector<uint32_t>& cacheTime,
+    uint32_t time,
+    std::vector<uint32_t>& deadEnds,
+    uint32_t& cursor)
+{
+    int32_t best = -1;
+    int32_t bestPriority = -1;
+    for (uint32_t vertex : candidates)
+    {
+        if (liveCount[vertex] == 0)
+            continue;
+
+        int32_t priority = 0;
+        if (time - cacheTime[vertex] + 2 * liveCount[vertex] <= VERTEX_CACHE_SIZE)
+            priority = time - cacheTime[vertex];
+
+        if (priority > bestPriority)
+        {
+            bestPriority = priority;
+            best = (int32_t)vertex;
+        }
+    }
+    if (best != -1)
+        return best;
+
+    while (!deadEnds.empty())
+    {
+        uint32_t vertex = deadEnds.back();
+        deadEnds.pop_back();
+        if (liveCount[vertex] > 0)
+            return (int32_t)vertex;
+    }
+
+    for (uint32_t len = (uint32_t)liveCount.size(); cursor < len; cursor++)
+    {
+        if (liveCount[cursor] > 0)
+            return (int32_t)cursor;
+    }
+    return -1;
+}
+
+// Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+static std::vector<uint32_t> tipsify(const std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+    uint32_t triangleCount = (uint32_t)indices.size() / 3;
+
+    // Vertex to triangle adjacency in compressed rows
+    std::vector<uint32_t> liveCount(vertexCount, 0);
+    for (uint32_t index : indices)
+        liveCount[index]++;
+
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t i = 0; i < vertexCount; i++)
+        offsets[i + 1] = offsets[i] + liveCount[i];
+
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0, len = (uint32_t)indices.size(); i < len; i++)
+        adjacency[fill[indices[i]]++] = i / 3;
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> order;
+    order.reserve(triangleCount);
+
+    uint32_t time = VERTEX_CACHE_SIZE + 1;
+    uint32_t cursor = 0;
+    int32_t fan = vertexCount > 0 ? 0 : -1;
+
+    while (fan >= 0)
+    {
+        candidates.clear();
+        for (uint32_t i = offsets[fan]; i < offsets[fan + 1]; i++)
+        {
+            uint32_t triangle = adjacency[i];
+            if (emitted[triangle])
+                continue;
+
+            for (int j = 0; j < 3; j++)
+            {
+                uint32_t vertex = indices[3 * triangle + j];
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                liveCount[vertex]--;
+                if (time - cacheTime[vertex] > VERTEX_CACHE_SIZE)
+                    cacheTime[vertex] = time++;
+            }
+            emitted[triangle] = true;
+            order.push_back(triangle);
+        }
+
+        fan = nextVertex(candidates, liveCount, cacheTime, time, deadEnds, cursor);
+    }
+
+    return order;
+}
+
+template<typename T>
+static void remapStream(std::vector<T>& stream, const std::vector<uint32_t>& newToOld)
+{
+    if (stream.size() != newToOld.size())
+        return;
+
+    std::vector<T> remapped(stream.size());
+    for (size_t i = 0, len = newToOld.size(); i < len; i++)
+        remapped[i] = stream[newToOld[i]];
+    stream.swap(remapped);
+}
+
+void optimizeMesh(MeshData& mesh)
+{
+    uint32_t vertexCount = (uint32_t)mesh.vertices.positions.size();
+    if (vertexCount == 0 || mesh.indices.size() % 3 != 0)
+        return;
+
+    // Triangle order
+    std::vector<uint32_t> order = tipsify(mesh.indices, vertexCount);
+    std::vector<uint32_t> indices(mesh.indices.size());
+    for (size_t i = 0, len = order.size(); i < len; i++)
+    {
+        for (int j = 0; j < 3; j++)
+            indices[3 * i + j] = mesh.indices[3 * order[i] + j];
+    }
+
+    // Vertex order, by first use in the new index buffer
+    std::vector<uint32_t> oldToNew(vertexCount, UINT32_MAX);
+    std::vector<uint32_t> newToOld;
+    newToOld.reserve(vertexCount);
+    for (uint32_t& index : indices)
+    {
+        if (oldToNew[index] == UINT32_MAX)
+        {
+            oldToNew[index] = (uint32_t)newToOld.size();
+            newToOld.push_back(index);
+        }
+        index = oldToNew[index];
+    }
+
+    // Unreferenced vertices keep their relative order at the end
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        if (oldToNew[i] == UINT32_MAX)
+        {
+            oldToNew[i] = (uint32_t)newToOld.size();
+            newToOld.push_back(i);
+        }
+    }
+
+    mesh.indices.swap(indices);
+    remapStream(mesh.vertices.positions, newToOld);
+    remapStream(mesh.vertices.normals, newToOld);
+    remapStream(mesh.vertices.uvs, newToOld);
+    remapStream(mesh.origIndices, newToOld);
+}
+
+VertexCacheStats analyzeVertexCache(const MeshData& mesh)
+{
+    uint32_t vertexCount = (uint32_t)mesh.vertices.positions.size();
+    std::vector<uint32_t> insertedAt(vertexCount, 0);
+    uint32_t misses = 0;
+
+    // A vertex is in the fifo if fewer than VERTEX_CACHE_SIZE misses happened since it was inserted
+    for (uint32_t index : mesh.indices)
+    {
+        if (insertedAt[index] == 0 || misses - insertedAt[index] >= VERTEX_CACHE_SIZE)
+            insertedAt[index] = ++misses;
+    }
+
+    VertexCacheStats stats{};
+    if (mesh.indices.size() >= 3)
+        stats.acmr = misses / (float)(mesh.indices.size() / 3);
+    if (vertexCount > 0)
+        stats.atvr = misses / (float)vertexCount;
+    return stats;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Mesh.h"
+
+// Post-transform cache size assumed when optimizing and when measuring
+const static uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats
+{
+	float acmr; // Average cache miss ratio, transformed vertices per triangle
+	float atvr; // Average transformed vertex ratio, transformed vertices per unique vertex
+};
+
+// Reorders the triangles for post-transform cache reuse (Tipsify), then renumbers the vertices in order of first use
+// so that vertex fetches walk the streams linearly. Every per vertex array of the mesh, origIndices included, is remapped
+void optimizeMesh(MeshData& mesh);
+
+// Simulates a fifo cache of VERTEX_CACHE_SIZE entries over the index buffer
+VertexCacheStats analyzeVertexCache(const MeshData& mesh);
@@ -8,12 +8,157 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
-#include "core/SpatialHash.h"
+#include "TetrahedralBVH.h"
+#include "core/RadixSort.h"
+#include "MeshOptimizer.h"
+#include "SignedDistanceField.h"
 
-void ResourceManager::init(Device& device, CommandPool& commandPool)
+#include <filesystem>
+
+struct DeformationCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t stride;
+};
+
+static const char DEFORMATION_CACHE_MAGIC[4] = { 'S', 'B', 'D', 'C' };
+
+// Bump when the embedding or the vertex/tet ordering of the loaders changes, old cache entries are then ignored
+static const uint32_t DEFORMATION_CACHE_VERSION = 3;
+
+struct SignedDistanceFieldCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    glm::vec3 origin;
+    float cellSize;
+    glm::uvec3 dims;
+};
+
+static const char SDF_CACHE_MAGIC[4] = { 'S', 'D', 'F', 'C' };
+
+// Bump when the sampling or the sign of the distance field changes
+static const uint32_t SDF_CACHE_VERSION = 1;
+
+// First fit colouring, each particle keeps a bit per colour of the constraints it is part of. Constraints of high valence
+// particles that find no colour below MAX_CONSTRAINT_COLORS are left for the atomic solve, after the last colour
+template<typename T, int N>
+static void colorConstraintSet(const std::vector<T>& constraints, uint32_t particleCount, std::vector<uint32_t>& order, std::vector<uint32_t>& offsets)
+{
+    static_assert(ResourceManager::MAX_CONSTRAINT_COLORS <= 64, "Colours are tracked in a 64 bit mask");
+
+    uint32_t count = (uint32_t)constraints.size();
+    std::vector<uint32_t> colors(count);
+    std::vector<uint64_t> used(particleCount, 0);
+    uint32_t colorCount = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint64_t mask = 0;
+        for (int j = 0; j < N; j++)
+            mask |= used[constraints[i].indices[j]];
+
+        uint32_t color = 0;
+        while (color < ResourceManager::MAX_CONSTRAINT_COLORS && (mask & (1ull << color)))
+            color++;
+        colors[i] = color;
+
+        if (color == ResourceManager::MAX_CONSTRAINT_COLORS)
+            continue;
+
+        for (int j = 0; j < N; j++)
+            used[constraints[i].indices[j]] |= 1ull << color;
+        colorCount = std::max(colorCount, color + 1);
+    }
+
+    // Counting sort by colour, indices stay ascending within a colour so the constraint reads remain coherent
+    offsets.assign(colorCount + 2, 0);
+    for (uint32_t i = 0; i < count; i++)
+        offsets[std::min(colors[i], colorCount) + 1]++;
+    for (uint32_t i = 0; i <= colorCount; i++)
+        offsets[i + 1] += offsets[i];
+
+    std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    order.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+        order[next[std::min(colors[i], colorCount)]++] = i;
+}
+
+// FNV-1a over the file contents, 0 if the file can't be read
+static uint64_t hashFile(const std::string& path)
+{
+    MappedFile file;
+    if (!file.init(path))
+        return 0;
+
+    const uint8_t* data = (const uint8_t*)file.getData();
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0, len = file.getSize(); i < len; i++)
+        hash = (hash ^ data[i]) * 1099511628211ull;
+
+    file.cleanup();
+    return hash;
+}
+
+// Spreads the low 10 bits of v so that there are two zero bits between each of them
+static uint32_t expandBits(uint32_t v)
+{
+    v &= 0x3FF;
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+static uint32_t mortonCode(glm::vec3 normalised)
+{
+    glm::uvec3 cell = glm::uvec3(glm::clamp(normalised * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f)));
+    return (expandBits(cell.x) << 2) | (expandBits(cell.y) << 1) | expandBits(cell.z);
+}
+
+static uint64_t hashVertexKey(glm::uvec3 key)
+{
+    uint64_t hash = ((uint64_t)key.x | ((uint64_t)key.y << 32)) * 0x9E3779B97F4A7C15ull;
+    hash ^= (uint64_t)key.z * 0xC2B2AE3D27D4EB4Full;
+    return hash ^ (hash >> 29);
+}
+
+static void initSharedBuffer(Device& device, UploadBatch& upload, Buffer& buffer, VkBufferUsageFlags usage, const void* data, VkDeviceSize size)
+{
+    // Zero sized buffers are invalid, an empty stream still gets a buffer so that it can be released uniformly
+    buffer.init(device,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        std::max(size, (VkDeviceSize)sizeof(uint32_t))
+    );
+    upload.add(buffer, data, size);
+}
+
+void ResourceManager::init(Device& device, CommandPool& commandPool, ThreadPool& threadPool)
 {
     s_device = &device;
     s_commandPool = &commandPool;
+    p_threadPool = &threadPool;
+}
+
+void ResourceManager::init(ThreadPool& threadPool)
+{
+    s_device = nullptr;
+    s_commandPool = nullptr;
+    p_threadPool = &threadPool;
+}
+
+void ResourceManager::cleanup()
+{
+    for (auto& softBody : m_softBodyModels)
+    {
+        if (softBody.second.buffers.refCount > 0)
+            LOG_WARNING("Soft body buffers are still referenced at cleanup: " + softBody.first);
+        softBody.second.asset.cleanup();
+    }
 }
 
 Texture ResourceManager::loadTexture(const std::string& path)
@@ -44,7 +189,7 @@ void ResourceManager::exportJPG(Texture& texture, const std::string& path)
     vkUnmapMemory(s_device->getLogical(), texture.getMemory());
 }
 
-MeshData ResourceManager::loadMeshOBJ(const std::string& path)
+MeshData ResourceManager::loadMeshOBJ(const std::string& path, bool optimize)
 {
     MeshData mesh;
     fastObjMesh* obj = fast_obj_read(path.c_str());
@@ -57,40 +202,55 @@ MeshData ResourceManager::loadMeshOBJ(const std::string& path)
     else if (obj->face_vertices[0] != 3)
     {
         LOG_WARNING("Failed to construct mesh from obj mesh: " + path + " The faces are not triangular!");
+        fast_obj_destroy(obj);
         return mesh;
     }
 
-    std::unordered_map<std::string, uint32_t> uniqueVertices{};
+    // Open addressing table keyed on the (position, normal, uv) indices, the unique vertex count can't exceed the index count.
+    // Sized in 64 bits, twice an index count above 2^31 doesn't fit in 32
+    size_t tableSize = 1;
+    while (tableSize < 2ull * obj->index_count)
+        tableSize <<= 1;
+    std::vector<glm::uvec3> tableKeys(tableSize);
+    std::vector<uint32_t> tableValues(tableSize, UINT32_MAX);
+
     mesh.indices.resize(obj->index_count);
 
     for (unsigned int i = 0; i < obj->index_count; i++)
     {
-        std::string key = std::to_string(obj->indices[i].p) + std::to_string(obj->indices[i].n) + std::to_string(obj->indices[i].t);
-        if (!uniqueVertices.count(key))
+        glm::uvec3 key(obj->indices[i].p, obj->indices[i].n, obj->indices[i].t);
+        size_t slot = hashVertexKey(key) & (tableSize - 1);
+        while (tableValues[slot] != UINT32_MAX && tableKeys[slot] != key)
+            slot = (slot + 1) & (tableSize - 1);
+
+        if (tableValues[slot] == UINT32_MAX)
         {
-            uniqueVertices[key] = static_cast<uint32_t>(mesh.vertices.positions.size());
+            tableKeys[slot] = key;
+            tableValues[slot] = static_cast<uint32_t>(mesh.vertices.positions.size());
             mesh.vertices.positions.push_back({ glm::vec3(
-                obj->positions[obj->indices[i].p * 3],
-                obj->positions[obj->indices[i].p * 3 + 1],
-                obj->positions[obj->indices[i].p * 3 + 2]
+                obj->positions[key.x * 3],
+                obj->positions[key.x * 3 + 1],
+                obj->positions[key.x * 3 + 2]
             ) });
             mesh.vertices.normals.push_back({ glm::vec3(
-                obj->normals[obj->indices[i].n * 3],
-                obj->normals[obj->indices[i].n * 3 + 1],
-                obj->normals[obj->indices[i].n * 3 + 2]
+                obj->normals[key.y * 3],
+                obj->normals[key.y * 3 + 1],
+                obj->normals[key.y * 3 + 2]
             ) });
             mesh.vertices.uvs.push_back(glm::vec2(
-                obj->texcoords[obj->indices[i].t * 2],
-                obj->texcoords[obj->indices[i].t * 2 + 1]
+                obj->texcoords[key.z * 2],
+                obj->texcoords[key.z * 2 + 1]
             ));
 
-            mesh.origIndices.push_back(obj->indices[i].p - 1);
+            mesh.origIndices.push_back(key.x - 1);
         }
 
-        mesh.indices[i] = uniqueVertices[key];
+        mesh.indices[i] = tableValues[slot];
     }
 
     fast_obj_destroy(obj);
+    if (optimize)
+        optimizeMesh(mesh);
     return mesh;
 }
 
@@ -107,6 +267,7 @@ TetrahedralMeshData ResourceManager::loadTetrahedralMeshOBJ(const std::string& p
     else if (obj->face_vertices[0] != 4)
     {
         LOG_WARNING("Failed to construct tetrahedral mesh from obj mesh: " + path + " Each \"face\" in the obj file should be used to define a tetrahedral.");
+        fast_obj_destroy(obj);
         return mesh;
     }
 
@@ -123,14 +284,6 @@ TetrahedralMeshData ResourceManager::loadTetrahedralMeshOBJ(const std::string& p
         mesh.particles[i - 1].invMass = 0.0f;
     }
 
-    const uint8_t surfaceIndices[12] = {
-        2, 1, 0,
-        0, 1, 3,
-        1, 2, 3,
-        2, 0, 3
-    };
-    std::set<std::string> uniqueEdges;
-    std::unordered_map<std::string, glm::uvec3> uniqueTriangles;
     for (int i = 0, len = (int)mesh.tets.size(); i < len; i++)
     {
         glm::uvec4 ids(
@@ -158,140 +311,429 @@ TetrahedralMeshData ResourceManager::loadTetrahedralMeshOBJ(const std::string& p
             mesh.particles[ids[2]].invMass += mass;
             mesh.particles[ids[3]].invMass += mass;
         }
+    }
+    for (unsigned int i = 0; i < obj->position_count - 1; i++)
+    {
+        mesh.particles[i].invMass = 1.0f / mesh.particles[i].invMass;
+    }
 
-        // Edges
-        for (int j = 0; j < 3; j++)
+    fast_obj_destroy(obj);
+    extractEdges(mesh);
+    return mesh;
+}
+
+void ResourceManager::extractEdges(TetrahedralMeshData& mesh)
+{
+    // Each tetrahedral has 6 edges, packed as (min << 32 | max) so that duplicates end up next to each other when sorted
+    uint32_t tetCount = (uint32_t)mesh.tets.size();
+    std::vector<uint64_t> keys(6 * (size_t)tetCount);
+    p_threadPool->parallelFor(tetCount, 4096, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; i++)
         {
-            for (int k = j + 1; k < 4; k++)
+            glm::uvec4 ids = mesh.tets[i].indices;
+            uint64_t* tetKeys = &keys[6 * (size_t)i];
+            for (int j = 0; j < 3; j++)
             {
-                glm::uvec2 edge(std::min(ids[j], ids[k]), std::max(ids[j], ids[k]));
-                std::string key = std::to_string(edge[0]) + std::to_string(edge[1]);
-
-                if (!uniqueEdges.count(key))
-                {
-                    mesh.edges.push_back({ edge, glm::length(mesh.particles[edge[0]].position - mesh.particles[edge[1]].position) });
-                    uniqueEdges.insert(key);
-                }
+                for (int k = j + 1; k < 4; k++)
+                    *tetKeys++ = ((uint64_t)std::min(ids[j], ids[k]) << 32) | std::max(ids[j], ids[k]);
             }
         }
+    });
+
+    radixSort(keys, *p_threadPool);
+
+    mesh.edges.clear();
+    for (size_t i = 0, len = keys.size(); i < len; i++)
+    {
+        if (i > 0 && keys[i] == keys[i - 1])
+            continue;
+
+        glm::uvec2 edge((uint32_t)(keys[i] >> 32), (uint32_t)keys[i]);
+        mesh.edges.push_back({ edge, glm::length(mesh.particles[edge[0]].position - mesh.particles[edge[1]].position) });
     }
-    for (unsigned int i = 0; i < obj->position_count - 1; i++)
+}
+
+void ResourceManager::reorderTetrahedralMesh(TetrahedralMeshData& mesh, std::vector<uint32_t>& particleRemap)
+{
+    uint32_t particleCount = (uint32_t)mesh.particles.size();
+    uint32_t tetCount = (uint32_t)mesh.tets.size();
+    if (!particleCount)
+        return;
+
+    glm::vec3 minPos = mesh.particles[0].position;
+    glm::vec3 maxPos = minPos;
+    for (auto& particle : mesh.particles)
     {
-        mesh.particles[i].invMass = 1.0f / mesh.particles[i].invMass;
+        minPos = glm::min(minPos, particle.position);
+        maxPos = glm::max(maxPos, particle.position);
     }
+    glm::vec3 invExtent = 1.0f / glm::max(maxPos - minPos, glm::vec3(1e-6f));
 
-    fast_obj_destroy(obj);
-    return mesh;
+    // Particles, (morton << 32 | index) carries the original index along, only the morton half needs sorting since the sort is stable
+    std::vector<uint64_t> keys(particleCount);
+    p_threadPool->parallelFor(particleCount, 16384, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; i++)
+            keys[i] = ((uint64_t)mortonCode((mesh.particles[i].position - minPos) * invExtent) << 32) | i;
+    });
+    radixSort(keys, *p_threadPool, 32);
+
+    std::vector<Particle> particles(particleCount);
+    particleRemap.resize(particleCount);
+    for (uint32_t i = 0; i < particleCount; i++)
+    {
+        uint32_t oldIndex = (uint32_t)keys[i];
+        particles[i] = mesh.particles[oldIndex];
+        particleRemap[oldIndex] = i;
+    }
+    mesh.particles.swap(particles);
+
+    // Tetrahedra, sorted by their lowest particle index
+    keys.resize(tetCount);
+    p_threadPool->parallelFor(tetCount, 16384, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            glm::uvec4& ids = mesh.tets[i].indices;
+            ids = glm::uvec4(particleRemap[ids.x], particleRemap[ids.y], particleRemap[ids.z], particleRemap[ids.w]);
+            keys[i] = ((uint64_t)std::min(std::min(ids.x, ids.y), std::min(ids.z, ids.w)) << 32) | i;
+        }
+    });
+    radixSort(keys, *p_threadPool, 32);
+
+    std::vector<Tetrahedral> tets(tetCount);
+    for (uint32_t i = 0; i < tetCount; i++)
+        tets[i] = mesh.tets[(uint32_t)keys[i]];
+    mesh.tets.swap(tets);
+
+    // Rebuilt edges come out sorted by their lowest particle index as well
+    extractEdges(mesh);
 }
 
-SoftBodyData* ResourceManager::getSoftBody(std::string name, int resolution)
+void ResourceManager::colorConstraints(TetrahedralMeshData& mesh)
 {
-    std::string key = name + std::to_string(resolution);
-    if (m_softBodyModels.count(key))
-        return &m_softBodyModels[key];
+    uint32_t particleCount = (uint32_t)mesh.particles.size();
+    colorConstraintSet<Tetrahedral, 4>(mesh.tets, particleCount, mesh.tetColorOrder, mesh.tetColorOffsets);
+    colorConstraintSet<Edge, 2>(mesh.edges, particleCount, mesh.edgeColorOrder, mesh.edgeColorOffsets);
+}
 
-    SoftBodyData data;
-    if (m_meshModels.count(name))
-        data.mesh = &m_meshModels[name];
-    else
+void ResourceManager::embedMesh(const MeshData& mesh, const TetrahedralMeshData& tetMesh, std::vector<DeformationInfo>& deformationInfo)
+{
+    uint32_t posCount = (uint32_t)mesh.vertices.positions.size();
+    deformationInfo.assign(posCount, DeformationInfo());
+
+    // Tets are candidates for vertices within their bounding sphere plus 0.1, the containing or closest candidate wins.
+    // Ties go to the lowest tet id, which makes the result independent of thread count
+    TetrahedralBVH bvh;
+    bvh.init(tetMesh, 0.1f);
+
+    p_threadPool->parallelFor(posCount, 256, [&](uint32_t begin, uint32_t end)
     {
-        MeshData mesh = ResourceManager::loadMeshOBJ("assets/models/" + name + ".obj");
-        if (!mesh.vertices.positions.size())
-            return nullptr;
-
-        m_meshModels.insert(
-            std::pair<std::string, MeshData>
-            (
-                name, mesh
-            )
-        );
-        data.mesh = &m_meshModels[name];
+        for (uint32_t i = begin; i < end; i++)
+        {
+            uint32_t tetId;
+            glm::vec3 weights;
+            if (bvh.locate(mesh.vertices.positions[i].vec, tetId, weights))
+            {
+                deformationInfo[i].tetId = tetId;
+                deformationInfo[i].weights = weights;
+            }
+        }
+    });
+}
+
+MeshData* ResourceManager::getMesh(const std::string& name)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto model = m_meshModels.find(name);
+        if (model != m_meshModels.end())
+            return &model->second;
     }
 
+    MeshData mesh = ResourceManager::loadMeshOBJ("assets/models/" + name + ".obj");
+    if (!mesh.vertices.positions.size())
+        return nullptr;
+
+    // Map nodes are stable, the pointer stays valid while other models are inserted
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return &m_meshModels.emplace(name, std::move(mesh)).first->second;
+}
+
+bool ResourceManager::buildSoftBody(SoftBodyData& data, const std::string& name, int resolution)
+{
     data.tetMesh = ResourceManager::loadTetrahedralMeshOBJ("assets/tet_models/" + name + "/" + std::to_string(resolution) + ".obj");
 
     if (!data.tetMesh.particles.size())
-        return nullptr;
+        return false;
+
+    std::vector<uint32_t> particleRemap;
+    reorderTetrahedralMesh(data.tetMesh, particleRemap);
+    colorConstraints(data.tetMesh);
+
+    // Full resolution particles are the render mesh vertices, so the render mesh follows them directly
+    if (resolution == 100)
+    {
+        const std::vector<uint32_t>& origIndices = data.mesh->origIndices;
+        data.vertexParticles.resize(origIndices.size());
+        for (size_t i = 0, len = origIndices.size(); i < len; i++)
+            data.vertexParticles[i] = particleRemap[origIndices[i]];
+    }
 
     // Barycentric weights
-    if(resolution != 100)
+    if (resolution != 100)
+    {
+        std::string cachePath = getDeformationCachePath(name, resolution);
+        if (!loadDeformationCache(cachePath, (uint32_t)data.mesh->vertices.positions.size(), data.deformationInfo))
+        {
+            embedMesh(*data.mesh, data.tetMesh, data.deformationInfo);
+            saveDeformationCache(cachePath, data.deformationInfo);
+        }
+    }
+
+    return true;
+}
+
+std::string ResourceManager::getDeformationCachePath(const std::string& name, int resolution)
+{
+    uint64_t meshHash = hashFile("assets/models/" + name + ".obj");
+    uint64_t tetHash = hashFile("assets/tet_models/" + name + "/" + std::to_string(resolution) + ".obj");
+
+    char key[64];
+    snprintf(key, sizeof(key), "%016llx_%016llx_%d", (unsigned long long)meshHash, (unsigned long long)tetHash, resolution);
+    return std::string(DEFORMATION_CACHE_DIRECTORY) + key + ".def";
+}
+
+bool ResourceManager::loadDeformationCache(const std::string& path, uint32_t vertexCount, std::vector<DeformationInfo>& deformationInfo)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open())
+        return false;
+
+    DeformationCacheHeader header{};
+    in.read((char*)&header, sizeof(DeformationCacheHeader));
+    if (!in || 
+        memcmp(header.magic, DEFORMATION_CACHE_MAGIC, sizeof(DEFORMATION_CACHE_MAGIC)) != 0 ||
+        header.version != DEFORMATION_CACHE_VERSION ||
+        header.stride != sizeof(DeformationInfo) ||
+        header.count != vertexCount)
+        return false;
+
+    deformationInfo.resize(vertexCount);
+    in.read((char*)deformationInfo.data(), sizeof(DeformationInfo) * vertexCount);
+    if (!in)
+    {
+        deformationInfo.clear();
+        return false;
+    }
+    return true;
+}
+
+void ResourceManager::saveDeformationCache(const std::string& path, const std::vector<DeformationInfo>& deformationInfo)
+{
+    std::error_code error;
+    std::filesystem::create_directories(DEFORMATION_CACHE_DIRECTORY, error);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
     {
-        int posCount = (int)data.mesh->vertices.positions.size();
-        data.deformationInfo.resize(posCount);
+        LOG_WARNING("Failed to write deformation cache: " + path);
+        return;
+    }
+
+    DeformationCacheHeader header{};
+    memcpy(header.magic, DEFORMATION_CACHE_MAGIC, sizeof(DEFORMATION_CACHE_MAGIC));
+    header.version = DEFORMATION_CACHE_VERSION;
+    header.count = (uint32_t)deformationInfo.size();
+    header.stride = sizeof(DeformationInfo);
 
-        std::vector<glm::vec3> positions(posCount);
-        for (int i = 0; i < posCount; i++)
-            positions[i] = data.mesh->vertices.positions[i].vec;
+    out.write((const char*)&header, sizeof(DeformationCacheHeader));
+    out.write((const char*)deformationInfo.data(), sizeof(DeformationInfo) * deformationInfo.size());
+}
 
-        SpatialHash hash;
-        hash.init(0.25f, positions);
-        std::vector<float> minDist(posCount, FLT_MAX);
+bool ResourceManager::loadSignedDistanceField(const std::string& name, uint32_t resolution, SignedDistanceFieldData& sdf)
+{
+    std::string meshPath = "assets/models/" + name + ".obj";
+    char key[64];
+    snprintf(key, sizeof(key), "%016llx_%u", (unsigned long long)hashFile(meshPath), resolution);
+    std::string cachePath = std::string(SDF_CACHE_DIRECTORY) + key + ".sdf";
 
-        // Iterate all tetrahedra
-        for (int i = 0, len = (int)data.tetMesh.tets.size(); i < len; i++)
+    std::ifstream in(cachePath, std::ios::binary);
+    if (in.is_open())
+    {
+        SignedDistanceFieldCacheHeader header{};
+        in.read((char*)&header, sizeof(SignedDistanceFieldCacheHeader));
+        // A truncated or corrupt header must not size the distances, the sample count has to fit in the rest of the file
+        uint64_t sampleCount = (uint64_t)header.dims.x * header.dims.y;
+        sampleCount = sampleCount <= UINT32_MAX ? sampleCount * header.dims.z : UINT64_MAX;
+        std::streamoff dataStart = in.tellg();
+        in.seekg(0, std::ios::end);
+        std::streamoff dataSize = in.tellg() - dataStart;
+        in.seekg(dataStart);
+        if (in &&
+            memcmp(header.magic, SDF_CACHE_MAGIC, sizeof(SDF_CACHE_MAGIC)) == 0 &&
+            header.version == SDF_CACHE_VERSION &&
+            std::min(header.dims.x, std::min(header.dims.y, header.dims.z)) >= 2 &&
+            sampleCount <= UINT32_MAX &&
+            sampleCount * sizeof(float) <= (uint64_t)dataSize)
         {
-            glm::uvec4 indices = data.tetMesh.tets[i].indices;
-            glm::vec3 tetCenter =
-                (data.tetMesh.particles[indices[0]].position +
-                    data.tetMesh.particles[indices[1]].position +
-                    data.tetMesh.particles[indices[2]].position +
-                    data.tetMesh.particles[indices[3]].position) * 0.25f;
-
-            float maxRadius = 0.0f;
-            for (int j = 0; j < 4; j++)
-            {
-                glm::vec3 diff = data.tetMesh.particles[indices[j]].position - tetCenter;
-                maxRadius = std::max(maxRadius, glm::length(diff));
-            }
-            maxRadius += 0.1f;
-
-            glm::mat3 matrix = glm::inverse(
-                glm::mat3(
-                    data.tetMesh.particles[indices[0]].position - data.tetMesh.particles[indices[3]].position,
-                    data.tetMesh.particles[indices[1]].position - data.tetMesh.particles[indices[3]].position,
-                    data.tetMesh.particles[indices[2]].position - data.tetMesh.particles[indices[3]].position
-                )
-            );
-
-            // Get nearby vertices
-            std::vector<uint32_t> ids = hash.query(tetCenter, maxRadius);
-            maxRadius *= maxRadius;
-            for (auto id : ids)
-            {
-                if (minDist[id] <= 0.0f)
-                    continue;
-
-                glm::vec3 diff = positions[id] - tetCenter;
-                if (glm::dot(diff, diff) > maxRadius)
-                    continue;
-
-                diff = positions[id] - data.tetMesh.particles[data.tetMesh.tets[i].indices[3]].position;
-                diff = matrix * diff;
-
-                // Invalid bary coordinates
-                if (isnan(diff.x) || isnan(diff.y) || isnan(diff.z))
-                    continue;
-
-                float baryCoords[4]{ diff.x, diff.y, diff.z, 1.0f - (diff.x + diff.y + diff.z) };
-                float maxDist = 0.0f;
-                for (int k = 0; k < 4; k++)
-                    maxDist = std::max(maxDist, -baryCoords[k]);
-
-                if (maxDist < minDist[id])
-                {
-                    minDist[id] = maxDist;
-                    data.deformationInfo[id].tetId = i;
-                    data.deformationInfo[id].weights = glm::vec3(baryCoords[0], baryCoords[1], baryCoords[2]);
-                }
-            }
+            sdf.origin = header.origin;
+            sdf.cellSize = header.cellSize;
+            sdf.dims = header.dims;
+            sdf.distances.resize(sdf.getSampleCount());
+            in.read((char*)sdf.distances.data(), sizeof(float) * sdf.distances.size());
+            if (in)
+                return true;
         }
+        in.close();
+    }
+
+    MeshData mesh = loadMeshOBJ(meshPath, false);
+    computeSignedDistanceField(mesh, resolution, *p_threadPool, sdf);
+    if (!sdf.distances.size())
+        return false;
+
+    std::error_code error;
+    std::filesystem::create_directories(SDF_CACHE_DIRECTORY, error);
+
+    std::ofstream out(cachePath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        LOG_WARNING("Failed to write signed distance field cache: " + cachePath);
+        return true;
+    }
+
+    SignedDistanceFieldCacheHeader header{};
+    memcpy(header.magic, SDF_CACHE_MAGIC, sizeof(SDF_CACHE_MAGIC));
+    header.version = SDF_CACHE_VERSION;
+    header.origin = sdf.origin;
+    header.cellSize = sdf.cellSize;
+    header.dims = sdf.dims;
+
+    out.write((const char*)&header, sizeof(SignedDistanceFieldCacheHeader));
+    out.write((const char*)sdf.distances.data(), sizeof(float) * sdf.distances.size());
+    return true;
+}
+
+bool ResourceManager::loadSoftBody(SoftBodyData& data, const std::string& name, int resolution)
+{
+    data.mesh = getMesh(name);
+    if (!data.mesh)
+        return false;
+
+    std::string assetPath = "assets/tet_models/" + name + "/" + std::to_string(resolution) + ".sbd";
+    if (data.asset.init(assetPath) && data.asset.getVertexCount() != (uint32_t)data.mesh->vertices.positions.size())
+    {
+        LOG_WARNING("Soft body asset does not match render mesh, convert it again: " + assetPath);
+        data.asset.cleanup();
+    }
+
+    return data.asset.isOpen() || buildSoftBody(data, name, resolution);
+}
+
+SoftBodyData* ResourceManager::getSoftBody(std::string name, int resolution)
+{
+    std::string key = name + std::to_string(resolution);
+
+    // The first request of a model builds it without the lock, requests for the same model wait on its future meanwhile
+    std::promise<SoftBodyData*> promise;
+    std::shared_future<SoftBodyData*> load;
+    bool building = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto entry = m_softBodyLoads.find(key);
+        building = entry == m_softBodyLoads.end();
+        if (building)
+            entry = m_softBodyLoads.emplace(key, promise.get_future().share()).first;
+        load = entry->second;
+    }
+    if (!building)
+        return load.get();
+
+    SoftBodyData data;
+    bool loaded = loadSoftBody(data, name, resolution);
+
+    // Failed loads are forgotten so that a later request tries again
+    SoftBodyData* softBody = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (loaded)
+            softBody = &m_softBodyModels.emplace(key, data).first->second;
+        else
+            m_softBodyLoads.erase(key);
     }
+    promise.set_value(softBody);
+    return softBody;
+}
+
+SoftBodyBuffers* ResourceManager::acquireSoftBodyBuffers(SoftBodyData& data, int resolution, UploadBatch& upload, bool& staged)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    SoftBodyBuffers& buffers = data.buffers;
+    staged = buffers.refCount++ == 0;
+    if (!staged)
+        return &buffers;
+
+    const MeshData& mesh = *data.mesh;
+    buffers.resident = false;
+    initSharedBuffer(*s_device, upload, buffers.indexBuffer, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        mesh.indices.data(), sizeof(uint32_t) * mesh.indices.size());
+    initSharedBuffer(*s_device, upload, buffers.uvBuffer, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        mesh.vertices.uvs.data(), sizeof(glm::vec2) * mesh.vertices.uvs.size());
+
+    // No tetrahedral deformation
+    if (resolution == 100)
+        initSharedBuffer(*s_device, upload, buffers.deformBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            data.getVertexParticles(), sizeof(uint32_t) * data.getVertexParticleCount());
+    // Tetrahedral deformation
+    else
+        initSharedBuffer(*s_device, upload, buffers.deformBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            data.getDeformationInfo(), sizeof(DeformationInfo) * data.getDeformationCount());
+
+    return &buffers;
+}
+
+void ResourceManager::releaseSoftBodyBuffers(SoftBodyBuffers* buffers, SoftBodyPool& pool)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
 
-    m_softBodyModels.insert(
-        std::pair<std::string, SoftBodyData>
-        (
-            key, data     
-        )
+    if (--buffers->refCount > 0)
+        return;
+
+    buffers->deformBuffer.cleanup();
+    buffers->uvBuffer.cleanup();
+    buffers->indexBuffer.cleanup();
+    pool.release(buffers->topology);
+    buffers->topology = SoftBodyRange();
+    buffers->resident = false;
+}
+
+void ResourceManager::setSoftBodyBuffersResident(SoftBodyBuffers* buffers)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    buffers->resident = true;
+}
+
+bool ResourceManager::isSoftBodyBuffersResident(SoftBodyBuffers* buffers)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return buffers->resident;
+}
+
+bool ResourceManager::exportSoftBody(const std::string& name, int resolution)
+{
+    SoftBodyData data;
+    data.mesh = getMesh(name);
+    if (!data.mesh || !buildSoftBody(data, name, resolution))
+        return false;
+
+    return SoftBodyAsset::write(
+        "assets/tet_models/" + name + "/" + std::to_string(resolution) + ".sbd",
+        data.tetMesh,
+        data.deformationInfo,
+        data.vertexParticles,
+        (uint32_t)data.mesh->vertices.positions.size()
     );
-    return &m_softBodyModels[key];
 }
@@ -3,11 +3,24 @@
 #include "Texture.h"
 #include "Mesh.h"
 #include "TetrahedralMesh.h"
+#include "SoftBodyAsset.h"
+#include "SignedDistanceField.h"
+#include "core/ThreadPool.h"
 
-struct DeformationInfo
+// Immutable gpu data of a soft body model, shared by all of its instances. The tetrahedra and edges are staged into the soft body pool once per model
+struct SoftBodyBuffers
 {
-	alignas(16) glm::vec3 weights = glm::vec3(0.0f);
-	alignas(4) uint32_t tetId = 0;
+	Buffer indexBuffer;
+	Buffer uvBuffer;
+
+	// Used to deform the original mesh, either directly in the form of indices or in the form of tetrahedral deformation
+	Buffer deformBuffer;
+
+	// Edges, tetrahedra and their colour orders in the soft body pool, staged by the first instance on the render thread
+	SoftBodyRange topology;
+
+	uint32_t refCount = 0;
+	bool resident = false; // Set once the upload that staged the buffers has completed, guarded by the resource manager's mutex
 };
 
 struct SoftBodyData
@@ -15,27 +28,108 @@ struct SoftBodyData
 	MeshData* mesh;
 	TetrahedralMeshData tetMesh;
 	std::vector<DeformationInfo> deformationInfo;
+	std::vector<uint32_t> vertexParticles; // Particle of each render vertex, only used at full resolution
+
+	// Mapped binary asset, used instead of tetMesh, deformationInfo and vertexParticles when open
+	SoftBodyAsset asset;
+
+	SoftBodyBuffers buffers;
+
+	inline const Particle* getParticles() const { return asset.isOpen() ? asset.getParticles() : tetMesh.particles.data(); }
+	inline const Tetrahedral* getTets() const { return asset.isOpen() ? asset.getTets() : tetMesh.tets.data(); }
+	inline const Edge* getEdges() const { return asset.isOpen() ? asset.getEdges() : tetMesh.edges.data(); }
+	inline const DeformationInfo* getDeformationInfo() const { return asset.isOpen() ? asset.getDeformationInfo() : deformationInfo.data(); }
+	inline const uint32_t* getVertexParticles() const { return asset.isOpen() ? asset.getVertexParticles() : vertexParticles.data(); }
+	inline const uint32_t* getTetColorOrder() const { return asset.isOpen() ? asset.getTetColorOrder() : tetMesh.tetColorOrder.data(); }
+	inline const uint32_t* getEdgeColorOrder() const { return asset.isOpen() ? asset.getEdgeColorOrder() : tetMesh.edgeColorOrder.data(); }
+	inline const uint32_t* getTetColorOffsets() const { return asset.isOpen() ? asset.getTetColorOffsets() : tetMesh.tetColorOffsets.data(); }
+	inline const uint32_t* getEdgeColorOffsets() const { return asset.isOpen() ? asset.getEdgeColorOffsets() : tetMesh.edgeColorOffsets.data(); }
+
+	inline uint32_t getParticleCount() const { return asset.isOpen() ? asset.getParticleCount() : (uint32_t)tetMesh.particles.size(); }
+	inline uint32_t getTetCount() const { return asset.isOpen() ? asset.getTetCount() : (uint32_t)tetMesh.tets.size(); }
+	inline uint32_t getEdgeCount() const { return asset.isOpen() ? asset.getEdgeCount() : (uint32_t)tetMesh.edges.size(); }
+	inline uint32_t getDeformationCount() const { return asset.isOpen() ? asset.getDeformationCount() : (uint32_t)deformationInfo.size(); }
+	inline uint32_t getVertexParticleCount() const { return asset.isOpen() ? asset.getVertexParticleCount() : (uint32_t)vertexParticles.size(); }
+	inline uint32_t getTetColorCount() const { return asset.isOpen() ? asset.getTetColorCount() : (uint32_t)tetMesh.tetColorOffsets.size() - 2; }
+	inline uint32_t getEdgeColorCount() const { return asset.isOpen() ? asset.getEdgeColorCount() : (uint32_t)tetMesh.edgeColorOffsets.size() - 2; }
 };
 
 class ResourceManager
 {
+public:
+	// Every colour is a dispatch per substep, constraints that need more colours are solved with atomics
+	const static uint32_t MAX_CONSTRAINT_COLORS = 64;
 private:
+	inline const static char* DEFORMATION_CACHE_DIRECTORY = "cache/deformation/";
+	inline const static char* SDF_CACHE_DIRECTORY = "cache/sdf/";
+
 	Device* s_device;
 	CommandPool* s_commandPool;
+	ThreadPool* p_threadPool;
 	std::unordered_map<std::string, MeshData> m_meshModels;
 	std::unordered_map<std::string, SoftBodyData> m_softBodyModels;
+	std::unordered_map<std::string, std::shared_future<SoftBodyData*>> m_softBodyLoads; // Keyed like m_softBodyModels, resolves once the model is built
+	std::mutex m_mutex; // Guards the model maps, only held for lookups and inserts so that models load in parallel
+
+	// Thread safe, a mesh requested by two threads at once may be parsed twice but is only kept once
+	MeshData* getMesh(const std::string& name);
+
+	// Maps the binary asset of the soft body if present, otherwise builds it from the obj files
+	bool loadSoftBody(SoftBodyData& data, const std::string& name, int resolution);
+
+	// Loads the tetrahedral mesh from obj and embeds the render mesh in it, data.mesh has to be set
+	bool buildSoftBody(SoftBodyData& data, const std::string& name, int resolution);
+
+	// Embeddings are cached on disk, keyed by the content hashes of the render and tetrahedral obj files
+	std::string getDeformationCachePath(const std::string& name, int resolution);
+	bool loadDeformationCache(const std::string& path, uint32_t vertexCount, std::vector<DeformationInfo>& deformationInfo);
+	void saveDeformationCache(const std::string& path, const std::vector<DeformationInfo>& deformationInfo);
 public:
-	void init(Device& device, CommandPool& commandPool);
+	void init(Device& device, CommandPool& commandPool, ThreadPool& threadPool);
+	// Only the cpu side loading functions can be used
+	void init(ThreadPool& threadPool);
+	void cleanup();
 
 	Texture loadTexture(const std::string& path);
 	void exportJPG(Texture& texture, const std::string& path);
 
 	// Note: The face format in the obj file must be triangular
-	MeshData loadMeshOBJ(const std::string& path);
+	// Triangles and vertices are reordered for the vertex cache and vertex fetch unless optimize is false
+	MeshData loadMeshOBJ(const std::string& path, bool optimize = true);
 
 	// Note: The face format in the obj file must be quadratic
 	TetrahedralMeshData loadTetrahedralMeshOBJ(const std::string& path);
 
+	// Builds the unique edges of all tetrahedra, sorted by (min index, max index)
+	void extractEdges(TetrahedralMeshData& mesh);
+
+	// Sorts the particles along a morton curve and the tetrahedra and edges by their lowest particle index,
+	// so that neighbouring constraint threads touch neighbouring particles. particleRemap receives the new index of each particle
+	void reorderTetrahedralMesh(TetrahedralMeshData& mesh, std::vector<uint32_t>& particleRemap);
+
+	// Greedy graph colouring of the tetrahedra and edges into sets without shared particles, for the atomic free solve.
+	// The constraints keep their order, the colour order arrays list their indices grouped by colour
+	void colorConstraints(TetrahedralMeshData& mesh);
+
+	// Computes the barycentric coordinates of each render vertex in its closest tetrahedral
+	void embedMesh(const MeshData& mesh, const TetrahedralMeshData& tetMesh, std::vector<DeformationInfo>& deformationInfo);
+
+	// Signed distance field of assets/models/<name>.obj, cached on disk keyed by the content hash of the obj file
+	bool loadSignedDistanceField(const std::string& name, uint32_t resolution, SignedDistanceFieldData& sdf);
+
+	// Uses assets/tet_models/<name>/<resolution>.sbd if present, otherwise the obj files. Thread safe
 	SoftBodyData* getSoftBody(std::string name, int resolution);
-};
 
+	// Returns the shared gpu buffers of a soft body and adds a reference. The first reference creates the buffers
+	// and stages them into upload, in which case staged is set and the caller has to mark them resident
+	SoftBodyBuffers* acquireSoftBodyBuffers(SoftBodyData& data, int resolution, UploadBatch& upload, bool& staged);
+	// Destroys the buffers and frees the topology in the pool once the last reference is gone, they can't be in use by the gpu anymore.
+	// Only called on the render thread, which owns the pool
+	void releaseSoftBodyBuffers(SoftBodyBuffers* buffers, SoftBodyPool& pool);
+	// Residency is written by the render thread and reset by workers acquiring the buffers, both under the lock
+	void setSoftBodyBuffersResident(SoftBodyBuffers* buffers);
+	bool isSoftBodyBuffersResident(SoftBodyBuffers* buffers);
+
+	// Writes the binary asset of a soft body next to its tetrahedral obj file
+	bool exportSoftBody(const std::string& name, int resolution);
+};
@@ -0,0 +1,63 @@
+#include "pch.h"
+#include "SignedDistanceField.h"
+#include "TriangleBVH.h"
+
+#include <cfloat>
+
+// Cells outside of the mesh bounds on every side, particles approach the surface from there
+static const uint32_t PADDING_CELLS = 3;
+
+// Slightly skewed from the axes, so that parity rays rarely run along edges of axis aligned geometry
+static const glm::vec3 PARITY_DIRECTIONS[3] =
+{
+    glm::vec3(1.0f, 0.00137f, 0.00291f),
+    glm::vec3(0.00213f, 1.0f, 0.00071f),
+    glm::vec3(0.00113f, 0.00317f, 1.0f)
+};
+
+void computeSignedDistanceField(const MeshData& mesh, uint32_t resolution, ThreadPool& threadPool, SignedDistanceFieldData& sdf)
+{
+    sdf.distances.clear();
+    sdf.dims = glm::uvec3(0);
+    if (mesh.indices.size() < 3 || resolution == 0)
+        return;
+
+    TriangleBVH bvh;
+    bvh.init(mesh.vertices.positions, mesh.indices);
+
+    glm::vec3 min(FLT_MAX);
+    glm::vec3 max(-FLT_MAX);
+    for (const avec3& position : mesh.vertices.positions)
+    {
+        min = glm::min(min, position.vec);
+        max = glm::max(max, position.vec);
+    }
+
+    glm::vec3 extent = max - min;
+    sdf.cellSize = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f)) / resolution;
+    sdf.origin = min - sdf.cellSize * PADDING_CELLS;
+    sdf.dims = glm::uvec3(glm::ceil(extent / sdf.cellSize)) + 2u * PADDING_CELLS + 1u;
+    sdf.distances.resize(sdf.getSampleCount());
+
+    uint32_t sliceSize = sdf.dims.x * sdf.dims.y;
+    threadPool.parallelFor(sdf.dims.z, 1, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t z = begin; z < end; z++)
+        {
+            for (uint32_t y = 0; y < sdf.dims.y; y++)
+            {
+                for (uint32_t x = 0; x < sdf.dims.x; x++)
+                {
+                    glm::vec3 point = sdf.origin + glm::vec3(x, y, z) * sdf.cellSize;
+
+                    uint32_t inside = 0;
+                    for (int i = 0; i < 3; i++)
+                        inside += bvh.countHits(point, glm::normalize(PARITY_DIRECTIONS[i])) & 1;
+
+                    float distance = bvh.distance(point);
+                    sdf.distances[z * sliceSize + y * sdf.dims.x + x] = inside >= 2 ? -distance : distance;
+                }
+            }
+        }
+    });
+}
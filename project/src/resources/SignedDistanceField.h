@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Mesh.h"
+#include "core/ThreadPool.h"
+
+// Signed distances sampled on the points of a regular grid, negative inside of the mesh
+struct SignedDistanceFieldData
+{
+	glm::vec3 origin; // Position of the first sample
+	float cellSize;
+	glm::uvec3 dims; // Samples along each axis
+	std::vector<float> distances; // x fastest, then y, then z
+
+	inline uint32_t getSampleCount() const { return dims.x * dims.y * dims.z; }
+};
+
+// Gpu header of the distance buffer, followed by the distances. Matches SDFSSBO in sdf_collision
+struct SignedDistanceFieldHeader
+{
+	glm::vec4 origin; // w is the cell size
+	glm::uvec4 dims;
+};
+
+// Samples the mesh on a grid with resolution cells along its longest axis, padded by a few cells on every side.
+// The sign is the majority of three ray parity tests, so the mesh should be closed
+void computeSignedDistanceField(const MeshData& mesh, uint32_t resolution, ThreadPool& threadPool, SignedDistanceFieldData& sdf);
@@ -0,0 +1,129 @@
+#include "pch.h"
+#include "SoftBodyAsset.h"
+
+static const uint64_t SECTION_ALIGNMENT = 16;
+
+static uint64_t alignSection(uint64_t offset)
+{
+	return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+static bool validSection(uint64_t offset, uint32_t count, uint32_t stride, size_t fileSize)
+{
+	return offset % SECTION_ALIGNMENT == 0 && offset + (uint64_t)count * stride <= fileSize;
+}
+
+template<typename T>
+static void writeSection(std::ofstream& out, uint64_t offset, const T* data, uint32_t count)
+{
+	static const char zeros[SECTION_ALIGNMENT]{};
+	uint64_t pos = (uint64_t)out.tellp();
+	out.write(zeros, offset - pos);
+	out.write((const char*)data, sizeof(T) * count);
+}
+
+bool SoftBodyAsset::init(const std::string& path)
+{
+	if (!m_file.init(path))
+		return false;
+
+	const SoftBodyAssetHeader* header = (const SoftBodyAssetHeader*)m_file.getData();
+	size_t size = m_file.getSize();
+
+	if (size < sizeof(SoftBodyAssetHeader) || memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0)
+	{
+		LOG_WARNING("Invalid soft body asset: " + path);
+		m_file.cleanup();
+		return false;
+	}
+	if (header->version != VERSION ||
+		header->particleStride != sizeof(Particle) ||
+		header->tetStride != sizeof(Tetrahedral) ||
+		header->edgeStride != sizeof(Edge) ||
+		header->deformationStride != sizeof(DeformationInfo))
+	{
+		LOG_WARNING("Outdated soft body asset, convert it again: " + path);
+		m_file.cleanup();
+		return false;
+	}
+	if (!validSection(header->particleOffset, header->particleCount, header->particleStride, size) ||
+		!validSection(header->tetOffset, header->tetCount, header->tetStride, size) ||
+		!validSection(header->edgeOffset, header->edgeCount, header->edgeStride, size) ||
+		!validSection(header->deformationOffset, header->deformationCount, header->deformationStride, size) ||
+		!validSection(header->vertexParticleOffset, header->vertexParticleCount, sizeof(uint32_t), size) ||
+		!validSection(header->tetColorOrderOffset, header->tetCount, sizeof(uint32_t), size) ||
+		!validSection(header->edgeColorOrderOffset, header->edgeCount, sizeof(uint32_t), size) ||
+		!validSection(header->tetColorOffset, header->tetColorCount + 2, sizeof(uint32_t), size) ||
+		!validSection(header->edgeColorOffset, header->edgeColorCount + 2, sizeof(uint32_t), size))
+	{
+		LOG_WARNING("Truncated soft body asset: " + path);
+		m_file.cleanup();
+		return false;
+	}
+
+	p_header = header;
+	return true;
+}
+
+void SoftBodyAsset::cleanup()
+{
+	m_file.cleanup();
+	p_header = nullptr;
+}
+
+bool SoftBodyAsset::write(
+	const std::string& path,
+	const TetrahedralMeshData& tetMesh,
+	const std::vector<DeformationInfo>& deformationInfo,
+	const std::vector<uint32_t>& vertexParticles,
+	uint32_t vertexCount)
+{
+	SoftBodyAssetHeader header{};
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.vertexCount = vertexCount;
+
+	header.particleCount = (uint32_t)tetMesh.particles.size();
+	header.tetCount = (uint32_t)tetMesh.tets.size();
+	header.edgeCount = (uint32_t)tetMesh.edges.size();
+	header.deformationCount = (uint32_t)deformationInfo.size();
+	header.vertexParticleCount = (uint32_t)vertexParticles.size();
+	header.tetColorCount = (uint32_t)tetMesh.tetColorOffsets.size() - 2;
+	header.edgeColorCount = (uint32_t)tetMesh.edgeColorOffsets.size() - 2;
+
+	header.particleStride = sizeof(Particle);
+	header.tetStride = sizeof(Tetrahedral);
+	header.edgeStride = sizeof(Edge);
+	header.deformationStride = sizeof(DeformationInfo);
+
+	header.particleOffset = alignSection(sizeof(SoftBodyAssetHeader));
+	header.tetOffset = alignSection(header.particleOffset + (uint64_t)header.particleCount * header.particleStride);
+	header.edgeOffset = alignSection(header.tetOffset + (uint64_t)header.tetCount * header.tetStride);
+	header.deformationOffset = alignSection(header.edgeOffset + (uint64_t)header.edgeCount * header.edgeStride);
+	header.vertexParticleOffset = alignSection(header.deformationOffset + (uint64_t)header.deformationCount * header.deformationStride);
+	header.tetColorOrderOffset = alignSection(header.vertexParticleOffset + (uint64_t)header.vertexParticleCount * sizeof(uint32_t));
+	header.edgeColorOrderOffset = alignSection(header.tetColorOrderOffset + (uint64_t)header.tetCount * sizeof(uint32_t));
+	header.tetColorOffset = alignSection(header.edgeColorOrderOffset + (uint64_t)header.edgeCount * sizeof(uint32_t));
+	header.edgeColorOffset = alignSection(header.tetColorOffset + (uint64_t)(header.tetColorCount + 2) * sizeof(uint32_t));
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+	{
+		LOG_WARNING("Failed to open soft body asset for writing: " + path);
+		return false;
+	}
+
+	out.write((const char*)&header, sizeof(SoftBodyAssetHeader));
+	writeSection(out, header.particleOffset, tetMesh.particles.data(), header.particleCount);
+	writeSection(out, header.tetOffset, tetMesh.tets.data(), header.tetCount);
+	writeSection(out, header.edgeOffset, tetMesh.edges.data(), header.edgeCount);
+	writeSection(out, header.deformationOffset, deformationInfo.data(), header.deformationCount);
+	writeSection(out, header.vertexParticleOffset, vertexParticles.data(), header.vertexParticleCount);
+	writeSection(out, header.tetColorOrderOffset, tetMesh.tetColorOrder.data(), header.tetCount);
+	writeSection(out, header.edgeColorOrderOffset, tetMesh.edgeColorOrder.data(), header.edgeCount);
+	writeSection(out, header.tetColorOffset, tetMesh.tetColorOffsets.data(), header.tetColorCount + 2);
+	writeSection(out, header.edgeColorOffset, tetMesh.edgeColorOffsets.data(), header.edgeColorCount + 2);
+	out.close();
+
+	return !out.fail();
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "core/MappedFile.h"
+#include "TetrahedralMesh.h"
+
+// Binary soft body container (.sbd), arrays are stored in the same layout as the gpu buffers
+// and can be uploaded straight from the mapped file
+struct SoftBodyAssetHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexCount; // Vertex count of the render mesh the deformation info was computed against
+
+	uint32_t particleCount;
+	uint32_t tetCount;
+	uint32_t edgeCount;
+	uint32_t deformationCount;
+
+	// Used to reject files written with a different struct layout
+	uint32_t particleStride;
+	uint32_t tetStride;
+	uint32_t edgeStride;
+	uint32_t deformationStride;
+	uint32_t vertexParticleCount; // Stored as uint32_t, only written at full resolution
+	uint32_t tetColorCount; // Colour offset sections hold count + 2 uint32_t, the last range is uncoloured
+	uint32_t edgeColorCount;
+
+	uint64_t particleOffset;
+	uint64_t tetOffset;
+	uint64_t edgeOffset;
+	uint64_t deformationOffset;
+	uint64_t vertexParticleOffset;
+	uint64_t tetColorOrderOffset; // tetCount uint32_t
+	uint64_t edgeColorOrderOffset; // edgeCount uint32_t
+	uint64_t tetColorOffset;
+	uint64_t edgeColorOffset;
+};
+
+class SoftBodyAsset
+{
+private:
+	MappedFile m_file;
+	const SoftBodyAssetHeader* p_header = nullptr;
+
+	template<typename T>
+	inline const T* getArray(uint64_t offset) const { return (const T*)((const char*)m_file.getData() + offset); }
+public:
+	const static uint32_t VERSION = 5;
+	inline const static char MAGIC[4] = { 'S', 'B', 'D', 'Y' };
+
+	// Returns false if the file does not exist or is not a valid asset of the current version
+	bool init(const std::string& path);
+	void cleanup();
+
+	static bool write(
+		const std::string& path,
+		const TetrahedralMeshData& tetMesh,
+		const std::vector<DeformationInfo>& deformationInfo,
+		const std::vector<uint32_t>& vertexParticles,
+		uint32_t vertexCount
+	);
+
+	inline bool isOpen() const { return p_header != nullptr; }
+
+	inline const Particle* getParticles() const { return getArray<Particle>(p_header->particleOffset); }
+	inline const Tetrahedral* getTets() const { return getArray<Tetrahedral>(p_header->tetOffset); }
+	inline const Edge* getEdges() const { return getArray<Edge>(p_header->edgeOffset); }
+	inline const DeformationInfo* getDeformationInfo() const { return getArray<DeformationInfo>(p_header->deformationOffset); }
+	inline const uint32_t* getVertexParticles() const { return getArray<uint32_t>(p_header->vertexParticleOffset); }
+	inline const uint32_t* getTetColorOrder() const { return getArray<uint32_t>(p_header->tetColorOrderOffset); }
+	inline const uint32_t* getEdgeColorOrder() const { return getArray<uint32_t>(p_header->edgeColorOrderOffset); }
+	inline const uint32_t* getTetColorOffsets() const { return getArray<uint32_t>(p_header->tetColorOffset); }
+	inline const uint32_t* getEdgeColorOffsets() const { return getArray<uint32_t>(p_header->edgeColorOffset); }
+
+	inline uint32_t getVertexCount() const { return p_header->vertexCount; }
+	inline uint32_t getParticleCount() const { return p_header->particleCount; }
+	inline uint32_t getTetCount() const { return p_header->tetCount; }
+	inline uint32_t getEdgeCount() const { return p_header->edgeCount; }
+	inline uint32_t getDeformationCount() const { return p_header->deformationCount; }
+	inline uint32_t getVertexParticleCount() const { return p_header->vertexParticleCount; }
+	inline uint32_t getTetColorCount() const { return p_header->tetColorCount; }
+	inline uint32_t getEdgeColorCount() const { return p_header->edgeColorCount; }
+};
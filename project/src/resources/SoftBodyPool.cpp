@@ -0,0 +1,164 @@
+#include "pch.h"
+#include "SoftBodyPool.h"
+
+static uint32_t alignCount(uint32_t count)
+{
+	return (count + SoftBodyPool::ALIGNMENT - 1) / SoftBodyPool::ALIGNMENT * SoftBodyPool::ALIGNMENT;
+}
+
+static void initPoolBuffer(Device& device, Buffer& buffer, VkDeviceSize size)
+{
+	buffer.init(device,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		size
+	);
+}
+
+uint32_t SoftBodyPool::allocate(Section& section, uint32_t count)
+{
+	count = alignCount(count);
+	if (count == 0)
+		return 0;
+
+	for (size_t i = 0; i < section.freeRanges.size(); i++)
+	{
+		glm::uvec2& range = section.freeRanges[i];
+		if (range.y < count)
+			continue;
+
+		uint32_t offset = range.x;
+		range.x += count;
+		range.y -= count;
+		if (range.y == 0)
+			section.freeRanges.erase(section.freeRanges.begin() + i);
+		return offset;
+	}
+	return section.capacity;
+}
+
+void SoftBodyPool::release(Section& section, uint32_t offset, uint32_t count)
+{
+	count = alignCount(count);
+	if (count == 0)
+		return;
+
+	// Merge with the free ranges directly before and after
+	auto next = std::lower_bound(section.freeRanges.begin(), section.freeRanges.end(), offset,
+		[](const glm::uvec2& range, uint32_t offset) { return range.x < offset; });
+	if (next != section.freeRanges.end() && offset + count == next->x)
+	{
+		next->x = offset;
+		next->y += count;
+	}
+	else
+		next = section.freeRanges.insert(next, glm::uvec2(offset, count));
+
+	if (next != section.freeRanges.begin())
+	{
+		auto previous = next - 1;
+		if (previous->x + previous->y == next->x)
+		{
+			previous->y += next->y;
+			section.freeRanges.erase(next);
+		}
+	}
+}
+
+void SoftBodyPool::grow(Section& section, uint32_t count)
+{
+	uint32_t capacity = std::max(2 * section.capacity, section.capacity + alignCount(count));
+	release(section, section.capacity, capacity - section.capacity);
+	section.capacity = capacity;
+}
+
+void SoftBodyPool::resize(Buffer& buffer, VkDeviceSize size)
+{
+	Buffer resized;
+	initPoolBuffer(*p_device, resized, size);
+	p_commandPool->copyBuffer(buffer, resized, buffer.getSize());
+	buffer.cleanup();
+	buffer = resized;
+}
+
+void SoftBodyPool::init(Device& device, CommandPool& commandPool)
+{
+	p_device = &device;
+	p_commandPool = &commandPool;
+	m_generation = 0;
+
+	for (Section* section : { &m_particles, &m_edges, &m_tets })
+	{
+		section->capacity = INITIAL_CAPACITY;
+		section->freeRanges = { glm::uvec2(0, INITIAL_CAPACITY) };
+	}
+
+	initPoolBuffer(device, m_particleBuffer, sizeof(Particle) * INITIAL_CAPACITY);
+	initPoolBuffer(device, m_positionBuffer, sizeof(PbdPositions) * INITIAL_CAPACITY);
+	initPoolBuffer(device, m_edgeBuffer, sizeof(Edge) * INITIAL_CAPACITY);
+	initPoolBuffer(device, m_tetBuffer, sizeof(Tetrahedral) * INITIAL_CAPACITY);
+	initPoolBuffer(device, m_edgeOrderBuffer, sizeof(uint32_t) * INITIAL_CAPACITY);
+	initPoolBuffer(device, m_tetOrderBuffer, sizeof(uint32_t) * INITIAL_CAPACITY);
+}
+
+void SoftBodyPool::cleanup()
+{
+	m_tetOrderBuffer.cleanup();
+	m_edgeOrderBuffer.cleanup();
+	m_tetBuffer.cleanup();
+	m_edgeBuffer.cleanup();
+	m_positionBuffer.cleanup();
+	m_particleBuffer.cleanup();
+}
+
+SoftBodyRange SoftBodyPool::allocate(uint32_t particleCount, uint32_t edgeCount, uint32_t tetCount)
+{
+	SoftBodyRange range;
+	range.particleCount = particleCount;
+	range.edgeCount = edgeCount;
+	range.tetCount = tetCount;
+
+	range.particleOffset = allocate(m_particles, particleCount);
+	range.edgeOffset = allocate(m_edges, edgeCount);
+	range.tetOffset = allocate(m_tets, tetCount);
+
+	bool growParticles = range.particleOffset == m_particles.capacity;
+	bool growEdges = range.edgeOffset == m_edges.capacity;
+	bool growTets = range.tetOffset == m_tets.capacity;
+	if (!growParticles && !growEdges && !growTets)
+		return range;
+
+	// Only happens while bodies are loaded. Earlier uploads and the previous frames may still use the buffers
+	p_device->waitIdle();
+	if (growParticles)
+	{
+		grow(m_particles, particleCount);
+		resize(m_particleBuffer, sizeof(Particle) * m_particles.capacity);
+		resize(m_positionBuffer, sizeof(PbdPositions) * m_particles.capacity);
+		range.particleOffset = allocate(m_particles, particleCount);
+	}
+	if (growEdges)
+	{
+		grow(m_edges, edgeCount);
+		resize(m_edgeBuffer, sizeof(Edge) * m_edges.capacity);
+		resize(m_edgeOrderBuffer, sizeof(uint32_t) * m_edges.capacity);
+		range.edgeOffset = allocate(m_edges, edgeCount);
+	}
+	if (growTets)
+	{
+		grow(m_tets, tetCount);
+		resize(m_tetBuffer, sizeof(Tetrahedral) * m_tets.capacity);
+		resize(m_tetOrderBuffer, sizeof(uint32_t) * m_tets.capacity);
+		range.tetOffset = allocate(m_tets, tetCount);
+	}
+	m_generation++;
+
+	return range;
+}
+
+void SoftBodyPool::release(const SoftBodyRange& range)
+{
+	release(m_particles, range.particleOffset, range.particleCount);
+	release(m_edges, range.edgeOffset, range.edgeCount);
+	release(m_tets, range.tetOffset, range.tetCount);
+}
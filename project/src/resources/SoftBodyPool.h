@@ -0,0 +1,108 @@
+#pragma once
+
+#include "graphics/Buffer.h"
+#include "graphics/UploadBatch.h"
+#include "graphics/CommandPool.h"
+
+// Particle data is laid out as std430 vec4 pairs, 32 bytes per particle instead of 48 under std140
+struct Particle
+{
+	alignas(16) glm::vec3 position;
+	alignas(4) float invMass;
+	alignas(16) glm::vec3 velocity;
+	alignas(4) float padding = 0.0f;
+};
+
+// The solver state of a particle. The inverse mass is mirrored from the particle so that the constraint kernels only read this buffer
+struct PbdPositions
+{
+	alignas(16) glm::vec3 predict;
+	alignas(4) float invMass;
+	alignas(16) glm::vec3 delta;
+	alignas(4) float padding = 0.0f;
+};
+
+static_assert(sizeof(Particle) == 32 && sizeof(PbdPositions) == 32, "Has to match the std430 structs in the shaders");
+
+struct Edge
+{
+	alignas(16) glm::uvec2 indices;
+	alignas(4) float restLen;
+};
+
+struct Tetrahedral
+{
+	alignas(16) glm::uvec4 indices;
+	alignas(4) float restVolume;
+};
+
+// Ranges of one soft body in the pool, in elements. Constraints index the particles of their body from 0,
+// so every instance of a model shares one edge and tetrahedron range
+struct SoftBodyRange
+{
+	uint32_t particleOffset = 0;
+	uint32_t particleCount = 0;
+	uint32_t edgeOffset = 0;
+	uint32_t edgeCount = 0;
+	uint32_t tetOffset = 0;
+	uint32_t tetCount = 0;
+};
+
+// Particles, predicted positions, edges and tetrahedra of all soft bodies in shared buffers, so that a solver stage
+// can cover every body with one dispatch. Bodies are given first fit ranges, the buffers grow when no range fits.
+// The colour orders of the edges and tetrahedra share the ranges of the constraints they order
+class SoftBodyPool
+{
+public:
+	// Ranges start on multiples of this many elements, which keeps every range offset a multiple of 256 bytes for descriptors
+	const static uint32_t ALIGNMENT = 32;
+	const static uint32_t INITIAL_CAPACITY = 16384;
+private:
+	struct Section
+	{
+		uint32_t capacity = 0;
+		std::vector<glm::uvec2> freeRanges; // (offset, count), sorted by offset
+	};
+
+	Device* p_device;
+	CommandPool* p_commandPool;
+
+	Buffer m_particleBuffer;
+	Buffer m_positionBuffer;
+	Buffer m_edgeBuffer;
+	Buffer m_tetBuffer;
+	Buffer m_edgeOrderBuffer;
+	Buffer m_tetOrderBuffer;
+
+	Section m_particles;
+	Section m_edges;
+	Section m_tets;
+	uint32_t m_generation = 0;
+
+	// Returns the offset of the range, or the capacity of the section if no free range fits
+	uint32_t allocate(Section& section, uint32_t count);
+	void release(Section& section, uint32_t offset, uint32_t count);
+	// Adds at least count elements to the end of the section, the contents of the buffer are kept
+	void grow(Section& section, uint32_t count);
+	void resize(Buffer& buffer, VkDeviceSize size);
+public:
+	void init(Device& device, CommandPool& commandPool);
+	void cleanup();
+
+	// Growing waits for the device to be idle and replaces the buffers, which bumps the generation.
+	// Counts of 0 allocate nothing, the particles of a body and the topology of its model are allocated separately
+	SoftBodyRange allocate(uint32_t particleCount, uint32_t edgeCount, uint32_t tetCount);
+	void release(const SoftBodyRange& range);
+
+	inline Buffer& getParticleBuffer() { return m_particleBuffer; }
+	inline Buffer& getPositionBuffer() { return m_positionBuffer; }
+	inline Buffer& getEdgeBuffer() { return m_edgeBuffer; }
+	inline Buffer& getTetBuffer() { return m_tetBuffer; }
+	inline Buffer& getEdgeOrderBuffer() { return m_edgeOrderBuffer; }
+	inline Buffer& getTetOrderBuffer() { return m_tetOrderBuffer; }
+
+	inline uint32_t getParticleCapacity() { return m_particles.capacity; }
+	inline uint32_t getEdgeCapacity() { return m_edges.capacity; }
+	inline uint32_t getTetCapacity() { return m_tets.capacity; }
+	inline uint32_t getGeneration() { return m_generation; } // Descriptors of the pool buffers have to be rewritten when it changes
+};
@@ -0,0 +1,222 @@
+#include "pch.h"
+#include "TetrahedralBVH.h"
+
+#include <cfloat>
+
+// Tight bounds are grown slightly so that points classified as inside by the barycentric test are never culled
+static const float BOUNDS_EPSILON = 1e-5f;
+
+void TetrahedralBVH::init(const TetrahedralMeshData& mesh, float padding)
+{
+    uint32_t tetCount = (uint32_t)mesh.tets.size();
+    m_inverses.resize(tetCount);
+    m_origins.resize(tetCount);
+    m_spheres.resize(tetCount);
+    m_nodes.clear();
+    m_tetIds.resize(tetCount);
+
+    std::vector<glm::vec3> centers(tetCount);
+    std::vector<glm::vec3> mins(tetCount);
+    std::vector<glm::vec3> maxs(tetCount);
+    for (uint32_t i = 0; i < tetCount; i++)
+    {
+        glm::vec3 p[4];
+        for (int j = 0; j < 4; j++)
+            p[j] = mesh.particles[mesh.tets[i].indices[j]].position;
+
+        m_inverses[i] = glm::inverse(glm::mat3(p[0] - p[3], p[1] - p[3], p[2] - p[3]));
+        m_origins[i] = p[3];
+
+        centers[i] = (p[0] + p[1] + p[2] + p[3]) * 0.25f;
+        float radius = 0.0f;
+        for (int j = 0; j < 4; j++)
+            radius = std::max(radius, glm::length(p[j] - centers[i]));
+        m_spheres[i] = glm::vec4(centers[i], radius + padding);
+
+        mins[i] = glm::min(glm::min(p[0], p[1]), glm::min(p[2], p[3]));
+        maxs[i] = glm::max(glm::max(p[0], p[1]), glm::max(p[2], p[3]));
+        glm::vec3 epsilon = (maxs[i] - mins[i]) * BOUNDS_EPSILON + BOUNDS_EPSILON;
+        mins[i] -= epsilon;
+        maxs[i] += epsilon;
+
+        m_tetIds[i] = i;
+    }
+
+    if (tetCount > 0)
+    {
+        m_nodes.reserve(2 * (tetCount / MAX_LEAF_SIZE + 1));
+        build(centers, mins, maxs, 0, tetCount, 0);
+    }
+}
+
+uint32_t TetrahedralBVH::build(const std::vector<glm::vec3>& centers, const std::vector<glm::vec3>& mins, const std::vector<glm::vec3>& maxs, uint32_t start, uint32_t count, uint32_t depth)
+{
+    uint32_t index = (uint32_t)m_nodes.size();
+    m_nodes.push_back(Node());
+
+    Node node{};
+    node.min = glm::vec3(FLT_MAX);
+    node.max = glm::vec3(-FLT_MAX);
+    node.paddedMin = glm::vec3(FLT_MAX);
+    node.paddedMax = glm::vec3(-FLT_MAX);
+    glm::vec3 centerMin(FLT_MAX);
+    glm::vec3 centerMax(-FLT_MAX);
+    node.tetExtent = 0.0f;
+    for (uint32_t i = start; i < start + count; i++)
+    {
+        uint32_t tetId = m_tetIds[i];
+        glm::vec4 sphere = m_spheres[tetId];
+        node.min = glm::min(node.min, mins[tetId]);
+        node.max = glm::max(node.max, maxs[tetId]);
+        node.paddedMin = glm::min(node.paddedMin, glm::vec3(sphere) - sphere.w);
+        node.paddedMax = glm::max(node.paddedMax, glm::vec3(sphere) + sphere.w);
+        centerMin = glm::min(centerMin, centers[tetId]);
+        centerMax = glm::max(centerMax, centers[tetId]);
+
+        glm::vec3 extent = glm::max(maxs[tetId] - centers[tetId], centers[tetId] - mins[tetId]);
+        node.tetExtent = std::max(node.tetExtent, std::max(extent.x, std::max(extent.y, extent.z)));
+    }
+
+    if (count <= MAX_LEAF_SIZE || depth + 1 >= MAX_DEPTH)
+    {
+        node.tetStart = start;
+        node.tetCount = count;
+        m_nodes[index] = node;
+        return index;
+    }
+
+    // Median split along the longest axis of the tet centers
+    glm::vec3 extent = centerMax - centerMin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    uint32_t half = count / 2;
+    std::nth_element(m_tetIds.begin() + start, m_tetIds.begin() + start + half, m_tetIds.begin() + start + count, [&](uint32_t a, uint32_t b)
+    {
+        return centers[a][axis] < centers[b][axis] || (centers[a][axis] == centers[b][axis] && a < b);
+    });
+
+    build(centers, mins, maxs, start, half, depth + 1);
+    node.rightChild = build(centers, mins, maxs, start + half, count - half, depth + 1);
+    node.tetCount = 0;
+    m_nodes[index] = node;
+    return index;
+}
+
+glm::vec3 TetrahedralBVH::barycentric(uint32_t tetId, glm::vec3 point) const
+{
+    return m_inverses[tetId] * (point - m_origins[tetId]);
+}
+
+float TetrahedralBVH::distance(uint32_t tetId, glm::vec3 point) const
+{
+    glm::vec3 diff = point - glm::vec3(m_spheres[tetId]);
+    if (glm::dot(diff, diff) > m_spheres[tetId].w * m_spheres[tetId].w)
+        return -1.0f;
+
+    glm::vec3 bary = barycentric(tetId, point);
+    if (isnan(bary.x) || isnan(bary.y) || isnan(bary.z))
+        return -1.0f;
+
+    float baryCoords[4]{ bary.x, bary.y, bary.z, 1.0f - (bary.x + bary.y + bary.z) };
+    float maxDist = 0.0f;
+    for (int k = 0; k < 4; k++)
+        maxDist = std::max(maxDist, -baryCoords[k]);
+    return maxDist;
+}
+
+static bool inBounds(glm::vec3 point, glm::vec3 min, glm::vec3 max)
+{
+    return point.x >= min.x && point.y >= min.y && point.z >= min.z && point.x <= max.x && point.y <= max.y && point.z <= max.z;
+}
+
+static float boundsDistance2(glm::vec3 point, glm::vec3 min, glm::vec3 max)
+{
+    glm::vec3 diff = point - glm::clamp(point, min, max);
+    return glm::dot(diff, diff);
+}
+
+bool TetrahedralBVH::locate(glm::vec3 point, uint32_t& tetId, glm::vec3& weights) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    uint32_t stack[MAX_DEPTH];
+    uint32_t stackSize = 0;
+    uint32_t bestId = UINT32_MAX;
+    float bestDist = FLT_MAX;
+
+    // Containing tets only need the tight bounds, which almost always settles the search in a single leaf
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        uint32_t index = stack[--stackSize];
+        const Node& node = m_nodes[index];
+        if (!inBounds(point, node.min, node.max))
+            continue;
+
+        if (node.tetCount == 0)
+        {
+            stack[stackSize++] = node.rightChild;
+            stack[stackSize++] = index + 1;
+            continue;
+        }
+
+        for (uint32_t i = node.tetStart; i < node.tetStart + node.tetCount; i++)
+        {
+            uint32_t id = m_tetIds[i];
+            if (id < bestId && distance(id, point) == 0.0f)
+                bestId = id;
+        }
+    }
+
+    if (bestId != UINT32_MAX)
+    {
+        tetId = bestId;
+        weights = barycentric(bestId, point);
+        return true;
+    }
+
+    // Outside every tet. A tet can only reach a barycentric distance d if the point lies in the tet scaled by 1 + 4d around its center,
+    // so nodes are culled by their tight bounds grown by that much, and the closer child is searched first to shrink d early
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        uint32_t index = stack[--stackSize];
+        const Node& node = m_nodes[index];
+        if (!inBounds(point, node.paddedMin, node.paddedMax))
+            continue;
+        if (bestDist != FLT_MAX)
+        {
+            float grow = (4.0f * bestDist + BOUNDS_EPSILON) * node.tetExtent + BOUNDS_EPSILON;
+            if (!inBounds(point, node.min - grow, node.max + grow))
+                continue;
+        }
+
+        if (node.tetCount == 0)
+        {
+            const Node& left = m_nodes[index + 1];
+            const Node& right = m_nodes[node.rightChild];
+            bool leftFirst = boundsDistance2(point, left.min, left.max) <= boundsDistance2(point, right.min, right.max);
+            stack[stackSize++] = leftFirst ? node.rightChild : index + 1;
+            stack[stackSize++] = leftFirst ? index + 1 : node.rightChild;
+            continue;
+        }
+
+        for (uint32_t i = node.tetStart; i < node.tetStart + node.tetCount; i++)
+        {
+            uint32_t id = m_tetIds[i];
+            float dist = distance(id, point);
+            if (dist >= 0.0f && (dist < bestDist || (dist == bestDist && id < bestId)))
+            {
+                bestId = id;
+                bestDist = dist;
+            }
+        }
+    }
+
+    if (bestId == UINT32_MAX)
+        return false;
+
+    tetId = bestId;
+    weights = barycentric(bestId, point);
+    return true;
+}
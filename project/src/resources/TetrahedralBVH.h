@@ -0,0 +1,45 @@
+#pragma once
+
+#include "TetrahedralMesh.h"
+
+// Bounding volume hierarchy over the tets of a tetrahedral mesh, used to locate the tet of a point in O(log T)
+class TetrahedralBVH
+{
+private:
+	const static uint32_t MAX_LEAF_SIZE = 4;
+	const static uint32_t MAX_DEPTH = 64;
+
+	// Depth first layout, the left child directly follows its parent. Leaves have a tet count
+	struct Node
+	{
+		glm::vec3 min;
+		uint32_t rightChild;
+		glm::vec3 max;
+		uint32_t tetStart;
+		glm::vec3 paddedMin;
+		uint32_t tetCount;
+		glm::vec3 paddedMax;
+		float tetExtent; // Largest distance along an axis from a tet center to its tight bounds
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_tetIds;
+
+	// Per tet, in mesh order
+	std::vector<glm::mat3> m_inverses;
+	std::vector<glm::vec3> m_origins;
+	std::vector<glm::vec4> m_spheres; // Center and padded bounding radius
+
+	uint32_t build(const std::vector<glm::vec3>& centers, const std::vector<glm::vec3>& mins, const std::vector<glm::vec3>& maxs, uint32_t start, uint32_t count, uint32_t depth);
+	glm::vec3 barycentric(uint32_t tetId, glm::vec3 point) const;
+	float distance(uint32_t tetId, glm::vec3 point) const;
+public:
+	// Tets are candidates for points within their bounding sphere grown by padding
+	void init(const TetrahedralMeshData& mesh, float padding);
+
+	// Containing tet with the lowest id, otherwise the candidate tet with the smallest barycentric distance (largest negative weight).
+	// Returns false if no tet is a candidate
+	bool locate(glm::vec3 point, uint32_t& tetId, glm::vec3& weights) const;
+
+	inline uint32_t getNodeCount() const { return (uint32_t)m_nodes.size(); }
+};
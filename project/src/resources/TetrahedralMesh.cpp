@@ -1,29 +1,64 @@
 #include "pch.h"
 #include "TetrahedralMesh.h"
 
-void TetrahedralMesh::init(Device& device, CommandPool& commandPool, TetrahedralMeshData* meshData, glm::vec3 offset)
+SoftBodyRange TetrahedralMesh::initTopology(
+	SoftBodyPool& pool,
+	UploadBatch& upload,
+	const Tetrahedral* tets,
+	const uint32_t* tetColorOrder,
+	uint32_t tetCount,
+	const Edge* edges,
+	const uint32_t* edgeColorOrder,
+	uint32_t edgeCount)
 {
-	p_device = &device;
-	p_commandPool = &commandPool;
-	p_meshData = meshData;
-	m_particleCount = (uint32_t)meshData->particles.size();
-	m_tetCount = (uint32_t)meshData->tets.size();
-	m_edgeCount = (uint32_t)meshData->edges.size();
+	SoftBodyRange topology = pool.allocate(0, edgeCount, tetCount);
 
-	std::vector<Particle> particleData(meshData->particles);
-	for (auto& particle : particleData)
-		particle.position += offset;
+	// The orders index the constraints of the model from 0, like the constraints index its particles
+	upload.add(pool.getEdgeBuffer(), edges, sizeof(Edge) * edgeCount, sizeof(Edge) * topology.edgeOffset);
+	upload.add(pool.getTetBuffer(), tets, sizeof(Tetrahedral) * tetCount, sizeof(Tetrahedral) * topology.tetOffset);
+	upload.add(pool.getEdgeOrderBuffer(), edgeColorOrder, sizeof(uint32_t) * edgeCount, sizeof(uint32_t) * topology.edgeOffset);
+	upload.add(pool.getTetOrderBuffer(), tetColorOrder, sizeof(uint32_t) * tetCount, sizeof(uint32_t) * topology.tetOffset);
+	return topology;
+}
+
+void TetrahedralMesh::init(
+	SoftBodyPool& pool,
+	UploadBatch& upload,
+	const Particle* particles,
+	uint32_t particleCount,
+	const SoftBodyRange& topology,
+	glm::vec3 offset)
+{
+	p_pool = &pool;
+	p_topology = &topology;
+	m_particles = pool.allocate(particleCount, 0, 0);
+
+	std::vector<Particle> particleData(particles, particles + particleCount);
+	std::vector<PbdPositions> positionData(particleCount);
+	for (uint32_t i = 0; i < particleCount; i++)
+	{
+		particleData[i].position += offset;
+		positionData[i].predict = particleData[i].position;
+		positionData[i].invMass = particleData[i].invMass;
+		positionData[i].delta = glm::vec3(0.0f);
+	}
 
-	initBuffer<Particle>(m_particleBuffer, particleData.data(), m_particleCount);
-	initBuffer<Tetrahedral>(m_tetBuffer, meshData->tets.data(), m_tetCount);
-	initBuffer<Edge>(m_edgeBuffer, meshData->edges.data(), m_edgeCount);
-	initBuffer<Particle>(m_pbdPosBuffer, particleData.data(), m_particleCount);
+	upload.add(pool.getParticleBuffer(), particleData.data(), getParticleSize(), getParticleOffset());
+	upload.add(pool.getPositionBuffer(), positionData.data(), getPbdPosSize(), getPbdPosOffset());
 }
 
 void TetrahedralMesh::cleanup()
 {
-	m_pbdPosBuffer.cleanup();
-	m_edgeBuffer.cleanup();
-	m_tetBuffer.cleanup();
-	m_particleBuffer.cleanup();
+	if (p_pool)
+		p_pool->release(m_particles);
+	p_pool = nullptr;
+	p_topology = nullptr;
+}
+
+SoftBodyRange TetrahedralMesh::getRange()
+{
+	SoftBodyRange range = *p_topology;
+	range.particleOffset = m_particles.particleOffset;
+	range.particleCount = m_particles.particleCount;
+	return range;
 }
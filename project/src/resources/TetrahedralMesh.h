@@ -1,25 +1,11 @@
 #pragma once
 
-#include "graphics/Buffer.h"
-#include "graphics/CommandPool.h"
+#include "SoftBodyPool.h"
 
-struct Particle
+struct DeformationInfo
 {
-	alignas(16) glm::vec3 position;
-	alignas(16) glm::vec3 velocity;
-	alignas(4) float invMass;
-};
-
-struct Edge
-{
-	alignas(16) glm::uvec2 indices;
-	alignas(4) float restLen;
-};
-
-struct Tetrahedral
-{
-	alignas(16) glm::uvec4 indices;
-	alignas(4) float restVolume;
+	alignas(16) glm::vec3 weights = glm::vec3(0.0f);
+	alignas(4) uint32_t tetId = 0;
 };
 
 struct TetrahedralMeshData
@@ -27,58 +13,67 @@ struct TetrahedralMeshData
 	std::vector<Particle> particles;
 	std::vector<Tetrahedral> tets;
 	std::vector<Edge> edges;
+
+	// Set by colouring, the constraints of colour c are order[offsets[c]] to order[offsets[c + 1] - 1] and share no particles.
+	// The last range holds the constraints left without a colour
+	std::vector<uint32_t> tetColorOrder;
+	std::vector<uint32_t> edgeColorOrder;
+	std::vector<uint32_t> tetColorOffsets;
+	std::vector<uint32_t> edgeColorOffsets;
 };
 
+// Particle state of one soft body, a range of the soft body pool. The constraints are the topology range of its model
 class TetrahedralMesh
 {
 private:
-	Device* p_device;
-	CommandPool* p_commandPool;
-	TetrahedralMeshData* p_meshData;
-
-	Buffer m_particleBuffer;
-	Buffer m_tetBuffer;
-	Buffer m_edgeBuffer;
-	Buffer m_pbdPosBuffer;
-
-	uint32_t m_particleCount;
-	uint32_t m_tetCount;
-	uint32_t m_edgeCount;
-
-	template<typename T>
-	void initBuffer(Buffer& buffer, const T* data, uint32_t count);
+	SoftBodyPool* p_pool = nullptr;
+	SoftBodyRange m_particles; // Only the particle range belongs to the mesh
+	const SoftBodyRange* p_topology = nullptr;
 public:
-	void init(Device& device, CommandPool& commandPool, TetrahedralMeshData* meshData, glm::vec3 offset = glm::vec3(0.0f));
-	void cleanup();
-
-	inline Buffer& getParticleBuffer() { return m_particleBuffer; }
-	inline Buffer& getTetBuffer() { return m_tetBuffer; }
-	inline Buffer& getEdgeBuffer() { return m_edgeBuffer; }
-	inline Buffer& getPbdPosBuffer() { return m_pbdPosBuffer; }
-
-	inline uint32_t getParticleCount() { return m_particleCount; }
-	inline uint32_t getTetCount() { return m_tetCount; }
-	inline uint32_t getEdgeCount() { return m_edgeCount; }
-};
-
-template<typename T>
-inline void TetrahedralMesh::initBuffer(Buffer& buffer, const T* data, uint32_t count)
-{
-	VkDeviceSize bufferSize = sizeof(T) * count;
-	Buffer stagingBuffer;
-	stagingBuffer.init(*p_device,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		bufferSize,
-		(void*)data
+	// Allocates and stages the edges and tetrahedra of a model and their colour orders once, for all of its instances.
+	// Has to be called on the render thread, the pool may grow
+	static SoftBodyRange initTopology(
+		SoftBodyPool& pool,
+		UploadBatch& upload,
+		const Tetrahedral* tets,
+		const uint32_t* tetColorOrder,
+		uint32_t tetCount,
+		const Edge* edges,
+		const uint32_t* edgeColorOrder,
+		uint32_t edgeCount
 	);
 
-	buffer.init(*p_device,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-		bufferSize
+	// Allocates the particles of the mesh in the pool and stages them moved by offset. The topology is only read once the body
+	// is in use, the instance staging it may still be queued. Has to be called on the render thread, the pool may grow
+	void init(
+		SoftBodyPool& pool,
+		UploadBatch& upload,
+		const Particle* particles,
+		uint32_t particleCount,
+		const SoftBodyRange& topology,
+		glm::vec3 offset = glm::vec3(0.0f)
 	);
+	void cleanup();
+
+	inline Buffer& getParticleBuffer() { return p_pool->getParticleBuffer(); }
+	inline Buffer& getTetBuffer() { return p_pool->getTetBuffer(); }
+	inline Buffer& getEdgeBuffer() { return p_pool->getEdgeBuffer(); }
+	inline Buffer& getPbdPosBuffer() { return p_pool->getPositionBuffer(); }
 
-	p_commandPool->copyBuffer(stagingBuffer, buffer, bufferSize);
-	stagingBuffer.cleanup();
-}
+	// Byte ranges of the mesh in the pool buffers, used for per body descriptors
+	inline VkDeviceSize getParticleOffset() { return sizeof(Particle) * m_particles.particleOffset; }
+	inline VkDeviceSize getParticleSize() { return sizeof(Particle) * m_particles.particleCount; }
+	inline VkDeviceSize getPbdPosOffset() { return sizeof(PbdPositions) * m_particles.particleOffset; }
+	inline VkDeviceSize getPbdPosSize() { return sizeof(PbdPositions) * m_particles.particleCount; }
+	inline VkDeviceSize getTetOffset() { return sizeof(Tetrahedral) * p_topology->tetOffset; }
+	inline VkDeviceSize getTetSize() { return sizeof(Tetrahedral) * p_topology->tetCount; }
+	inline VkDeviceSize getEdgeOffset() { return sizeof(Edge) * p_topology->edgeOffset; }
+	inline VkDeviceSize getEdgeSize() { return sizeof(Edge) * p_topology->edgeCount; }
+
+	// The particles of the mesh and the topology of its model, as written to the body table
+	SoftBodyRange getRange();
+	inline bool isAllocated() { return p_pool != nullptr; }
+	inline uint32_t getParticleCount() { return m_particles.particleCount; }
+	inline uint32_t getTetCount() { return p_topology->tetCount; }
+	inline uint32_t getEdgeCount() { return p_topology->edgeCount; }
+};
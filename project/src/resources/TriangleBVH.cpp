@@ -0,0 +1,238 @@
+#include "pch.h"
+#include "TriangleBVH.h"
+
+#include <cfloat>
+
+void TriangleBVH::init(const std::vector<avec3>& positions, const std::vector<uint32_t>& indices)
+{
+    uint32_t triCount = (uint32_t)indices.size() / 3;
+    m_nodes.clear();
+    m_triangles.clear();
+
+    std::vector<uint32_t> triIds(triCount);
+    std::vector<glm::vec3> centers(triCount);
+    std::vector<glm::vec3> mins(triCount);
+    std::vector<glm::vec3> maxs(triCount);
+    for (uint32_t i = 0; i < triCount; i++)
+    {
+        glm::vec3 p0 = positions[indices[3 * i]].vec;
+        glm::vec3 p1 = positions[indices[3 * i + 1]].vec;
+        glm::vec3 p2 = positions[indices[3 * i + 2]].vec;
+
+        mins[i] = glm::min(p0, glm::min(p1, p2));
+        maxs[i] = glm::max(p0, glm::max(p1, p2));
+        centers[i] = (mins[i] + maxs[i]) * 0.5f;
+        triIds[i] = i;
+    }
+
+    if (triCount == 0)
+        return;
+
+    m_nodes.reserve(2 * (triCount / MAX_LEAF_SIZE + 1));
+    build(triIds, centers, mins, maxs, 0, triCount, 0);
+
+    // Triangles are stored in leaf order, so that a leaf reads one contiguous range
+    m_triangles.resize(triCount);
+    for (uint32_t i = 0; i < triCount; i++)
+    {
+        uint32_t triId = triIds[i];
+        glm::vec3 p0 = positions[indices[3 * triId]].vec;
+        m_triangles[i].v0 = p0;
+        m_triangles[i].e1 = positions[indices[3 * triId + 1]].vec - p0;
+        m_triangles[i].e2 = positions[indices[3 * triId + 2]].vec - p0;
+    }
+}
+
+uint32_t TriangleBVH::build(std::vector<uint32_t>& triIds, const std::vector<glm::vec3>& centers, const std::vector<glm::vec3>& mins, const std::vector<glm::vec3>& maxs, uint32_t start, uint32_t count, uint32_t depth)
+{
+    uint32_t index = (uint32_t)m_nodes.size();
+    m_nodes.push_back(Node());
+
+    Node node{};
+    node.min = glm::vec3(FLT_MAX);
+    node.max = glm::vec3(-FLT_MAX);
+    glm::vec3 centerMin(FLT_MAX);
+    glm::vec3 centerMax(-FLT_MAX);
+    for (uint32_t i = start; i < start + count; i++)
+    {
+        uint32_t triId = triIds[i];
+        node.min = glm::min(node.min, mins[triId]);
+        node.max = glm::max(node.max, maxs[triId]);
+        centerMin = glm::min(centerMin, centers[triId]);
+        centerMax = glm::max(centerMax, centers[triId]);
+    }
+
+    if (count <= MAX_LEAF_SIZE || depth + 1 >= MAX_DEPTH)
+    {
+        node.rightChild = start;
+        node.triCount = count;
+        m_nodes[index] = node;
+        return index;
+    }
+
+    // Median split along the longest axis of the triangle centers
+    glm::vec3 extent = centerMax - centerMin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    uint32_t half = count / 2;
+    std::nth_element(triIds.begin() + start, triIds.begin() + start + half, triIds.begin() + start + count, [&](uint32_t a, uint32_t b)
+    {
+        return centers[a][axis] < centers[b][axis] || (centers[a][axis] == centers[b][axis] && a < b);
+    });
+
+    build(triIds, centers, mins, maxs, start, half, depth + 1);
+    node.rightChild = build(triIds, centers, mins, maxs, start + half, count - half, depth + 1);
+    node.triCount = 0;
+    m_nodes[index] = node;
+    return index;
+}
+
+float TriangleBVH::boundsDistance2(uint32_t node, glm::vec3 point) const
+{
+    glm::vec3 diff = glm::max(glm::max(m_nodes[node].min - point, point - m_nodes[node].max), glm::vec3(0.0f));
+    return glm::dot(diff, diff);
+}
+
+float TriangleBVH::intersectTriangle(uint32_t tri, glm::vec3 origin, glm::vec3 dir) const
+{
+    const Triangle& triangle = m_triangles[tri];
+    glm::vec3 p = glm::cross(dir, triangle.e2);
+    float det = glm::dot(triangle.e1, p);
+    if (std::abs(det) < 1e-12f)
+        return -1.0f;
+
+    float invDet = 1.0f / det;
+    glm::vec3 hit = origin - triangle.v0;
+    float u = glm::dot(hit, p) * invDet;
+    if (u < 0.0f || u > 1.0f)
+        return -1.0f;
+
+    glm::vec3 q = glm::cross(hit, triangle.e1);
+    float v = glm::dot(dir, q) * invDet;
+    if (v < 0.0f || u + v > 1.0f)
+        return -1.0f;
+
+    return glm::dot(triangle.e2, q) * invDet;
+}
+
+// Ericson, "Real-Time Collision Detection" 5.1.5
+static glm::vec3 closestPointOnTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 ab, glm::vec3 ac)
+{
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+
+    glm::vec3 bp = ap - ab;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return a + ab;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 cp = ap - ac;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return a + ac;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return a + ab + (ac - ab) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+float TriangleBVH::distance(glm::vec3 point) const
+{
+    if (m_nodes.empty())
+        return FLT_MAX;
+
+    // Nearest child first, nodes further away than the closest triangle so far are skipped
+    float best2 = FLT_MAX;
+    uint32_t stack[MAX_DEPTH];
+    uint32_t stackSize = 0;
+    uint32_t node = 0;
+    while (true)
+    {
+        if (m_nodes[node].triCount > 0)
+        {
+            for (uint32_t i = m_nodes[node].rightChild, end = i + m_nodes[node].triCount; i < end; i++)
+            {
+                const Triangle& triangle = m_triangles[i];
+                glm::vec3 diff = point - closestPointOnTriangle(point, triangle.v0, triangle.e1, triangle.e2);
+                best2 = std::min(best2, glm::dot(diff, diff));
+            }
+        }
+        else
+        {
+            uint32_t left = node + 1;
+            uint32_t right = m_nodes[node].rightChild;
+            float leftDist2 = boundsDistance2(left, point);
+            float rightDist2 = boundsDistance2(right, point);
+            if (leftDist2 > rightDist2)
+            {
+                std::swap(left, right);
+                std::swap(leftDist2, rightDist2);
+            }
+
+            if (leftDist2 < best2)
+            {
+                if (rightDist2 < best2)
+                    stack[stackSize++] = right;
+                node = left;
+                continue;
+            }
+        }
+
+        // Popped nodes are tested again, best2 may have shrunk since they were pushed
+        do
+        {
+            if (stackSize == 0)
+                return std::sqrt(best2);
+            node = stack[--stackSize];
+        } while (boundsDistance2(node, point) >= best2);
+    }
+}
+
+uint32_t TriangleBVH::countHits(glm::vec3 origin, glm::vec3 dir) const
+{
+    if (m_nodes.empty())
+        return 0;
+
+    glm::vec3 invDir = 1.0f / dir;
+    uint32_t hits = 0;
+    uint32_t stack[MAX_DEPTH];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+        glm::vec3 t0 = (node.min - origin) * invDir;
+        glm::vec3 t1 = (node.max - origin) * invDir;
+        glm::vec3 tMin = glm::min(t0, t1);
+        glm::vec3 tMax = glm::max(t0, t1);
+        if (std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f)) > std::min(std::min(tMax.x, tMax.y), tMax.z))
+            continue;
+
+        if (node.triCount > 0)
+        {
+            for (uint32_t i = node.rightChild, end = i + node.triCount; i < end; i++)
+                hits += intersectTriangle(i, origin, dir) > 0.0f;
+        }
+        else
+        {
+            stack[stackSize++] = (uint32_t)(&node - m_nodes.data()) + 1;
+            stack[stackSize++] = node.rightChild;
+        }
+    }
+    return hits;
+}
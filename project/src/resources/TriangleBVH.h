@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Mesh.h"
+
+// Bounding volume hierarchy over static collider triangles, built once on the cpu and traversed by the collision shaders
+class TriangleBVH
+{
+public:
+	const static uint32_t MAX_LEAF_SIZE = 4;
+	const static uint32_t MAX_DEPTH = 64; // Matches the traversal stack size in static_collision_detection
+
+	// Depth first layout, the left child directly follows its parent. Leaves have a triangle count and
+	// keep their first triangle in place of the right child, matches BVHNode in the shaders
+	struct Node
+	{
+		glm::vec3 min;
+		uint32_t rightChild;
+		glm::vec3 max;
+		uint32_t triCount;
+	};
+
+	// Vertex and edges, so that the ray test needs no index lookups
+	struct Triangle
+	{
+		alignas(16) glm::vec3 v0;
+		alignas(16) glm::vec3 e1;
+		alignas(16) glm::vec3 e2;
+	};
+private:
+	std::vector<Node> m_nodes;
+	std::vector<Triangle> m_triangles; // In leaf order
+
+	uint32_t build(std::vector<uint32_t>& triIds, const std::vector<glm::vec3>& centers, const std::vector<glm::vec3>& mins, const std::vector<glm::vec3>& maxs, uint32_t start, uint32_t count, uint32_t depth);
+	float boundsDistance2(uint32_t node, glm::vec3 point) const;
+	float intersectTriangle(uint32_t tri, glm::vec3 origin, glm::vec3 dir) const;
+public:
+	void init(const std::vector<avec3>& positions, const std::vector<uint32_t>& indices);
+
+	// Unsigned distance from point to the closest triangle, FLT_MAX without triangles
+	float distance(glm::vec3 point) const;
+	// Number of triangles crossed by the ray, odd inside of a closed mesh
+	uint32_t countHits(glm::vec3 origin, glm::vec3 dir) const;
+
+	inline const std::vector<Node>& getNodes() const { return m_nodes; }
+	inline const std::vector<Triangle>& getTriangles() const { return m_triangles; }
+	inline uint32_t getNodeCount() const { return (uint32_t)m_nodes.size(); }
+	inline uint32_t getTriangleCount() const { return (uint32_t)m_triangles.size(); }
+};